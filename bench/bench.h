@@ -0,0 +1,35 @@
+/**
+ * @file bench.h
+ * @brief small timing harness shared by the benchmark programs.
+ *
+ * Every benchmark measures a number of operations and hands the elapsed
+ * time to bench_record(). main.c collects the records and prints them as
+ * one JSON document on stdout, so runs can be compared with each other.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+#include <stdint.h>
+
+/** monotonic clock in nanoseconds */
+uint64_t bench_now( void );
+
+/**
+ * @brief records one measurement.
+ *
+ * @param group     component that is measured ("mem", "itab", "unsd")
+ * @param name      operation that is measured
+ * @param size      size parameter of the run (bytes or rows)
+ * @param ops       number of operations performed
+ * @param ns        elapsed time in nanoseconds for all operations
+ */
+void bench_record( const char *group, const char *name, long size,
+                   uint64_t ops, uint64_t ns );
+
+/** largest table size used by the itab benchmarks */
+extern long g_bench_max_rows;
+
+void bench_mem( void );
+void bench_itab( void );
+void bench_unsd( const char *path );
+
+#endif // BENCH_H
@@ -0,0 +1,154 @@
+/**
+ * @file itab.c
+ * @brief micro benchmarks of the internal tables.
+ *
+ * Tables of 10, 100, ... rows up to g_bench_max_rows are built from keys in
+ * a fixed pseudo random order, then every key is read back and the table
+ * is iterated once. itab_insert sorts the whole table on every call, so
+ * tables above INSERT_MAX_ROWS rows are built with itab_insert_batch and
+ * have no insert measurement. The table is joined with itself by lookups, by a merge
+ * and by a parallel merge. Finally every key is upserted and every second one is
+ * deleted. Tables built in one batch are compared with fixed key tables.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "mem.h"
+#include "itab.h"
+#include "bench.h"
+
+#define KEY_LEN 9
+/** largest table that is built by single inserts */
+#define INSERT_MAX_ROWS 10000
+
+/**
+ * @brief creates count keys in a shuffled but repeatable order.
+ */
+static char *make_keys( long count ) {
+    char *keys = malloc( count * KEY_LEN );
+    unsigned long long seed = 42;
+    // eight digits, unique for up to 10^8 keys
+    for( long i = 0; i < count; i++ )
+        snprintf( keys + i * KEY_LEN, KEY_LEN, "%08ld", i % 100000000 );
+    for( long i = count - 1; i > 0; i-- ) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        long j = ( long )( ( seed >> 33 ) % ( unsigned long long )( i + 1 ) );
+        char tmp[KEY_LEN];
+        memcpy( tmp, keys + i * KEY_LEN, KEY_LEN );
+        memcpy( keys + i * KEY_LEN, keys + j * KEY_LEN, KEY_LEN );
+        memcpy( keys + j * KEY_LEN, tmp, KEY_LEN );
+    }
+    return keys;
+}
+
+static long g_joined;
+
+static void count_pair( const char *key, void *left, void *right,
+                        void *user ) {
+    ( void )key;
+    ( void )left;
+    ( void )right;
+    ( void )user;
+    __atomic_fetch_add( &g_joined, 1, __ATOMIC_RELAXED );
+}
+
+static void bench_itab_size( long rows ) {
+    char *keys = make_keys( rows );
+    const char **key_ptrs = malloc( rows * sizeof( char * ) );
+    for( long i = 0; i < rows; i++ )
+        key_ptrs[i] = keys + i * KEY_LEN;
+    uint64_t t0;
+    long found = 0;
+
+    t_itab itab = itab_new(  );
+    if( rows <= INSERT_MAX_ROWS ) {
+        t0 = bench_now(  );
+        for( long i = 0; i < rows; i++ )
+            itab_insert( itab, keys + i * KEY_LEN, keys + i * KEY_LEN );
+        bench_record( "itab", "insert", rows, rows, bench_now(  ) - t0 );
+    } else
+        itab_insert_batch( itab, rows, key_ptrs, ( void ** )key_ptrs );
+
+    t0 = bench_now(  );
+    for( long i = 0; i < rows; i++ )
+        if( itab_read( itab, keys + i * KEY_LEN ) )
+            found++;
+    bench_record( "itab", "read", rows, rows, bench_now(  ) - t0 );
+    if( found != rows )
+        fprintf( stderr, "bench: %ld of %ld keys found\n", found, rows );
+
+    t0 = bench_now(  );
+    found = 0;
+    for( t_itab_iter i = itab_foreach( itab ); i; i = itab_next( i ) )
+        if( itab_value( i ) )
+            found++;
+    bench_record( "itab", "iterate", rows, found, bench_now(  ) - t0 );
+
+    // joining the table with itself, by lookups and by a merge
+    t0 = bench_now(  );
+    found = 0;
+    for( t_itab_iter i = itab_foreach( itab ); i; i = itab_next( i ) )
+        if( itab_read( itab, itab_key( i ) ) )
+            found++;
+    bench_record( "itab", "join_read", rows, found, bench_now(  ) - t0 );
+
+    t0 = bench_now(  );
+    g_joined = 0;
+    itab_join( itab, itab, count_pair, NULL );
+    bench_record( "itab", "join", rows, g_joined, bench_now(  ) - t0 );
+
+    t0 = bench_now(  );
+    g_joined = 0;
+    itab_join_parallel( itab, itab, 4, count_pair, NULL );
+    bench_record( "itab", "join_parallel", rows, g_joined,
+                  bench_now(  ) - t0 );
+
+    t0 = bench_now(  );
+    for( long i = 0; i < rows; i++ )
+        itab_upsert( itab, keys + i * KEY_LEN, keys + i * KEY_LEN );
+    bench_record( "itab", "upsert", rows, rows, bench_now(  ) - t0 );
+
+    t0 = bench_now(  );
+    for( long i = 0; i < rows; i += 2 )
+        itab_delete( itab, keys + i * KEY_LEN );
+    bench_record( "itab", "delete", rows, ( rows + 1 ) / 2,
+                  bench_now(  ) - t0 );
+
+    t0 = bench_now(  );
+    itab = itab_free( itab );
+    bench_record( "itab", "free", rows, rows, bench_now(  ) - t0 );
+
+    t0 = bench_now(  );
+    itab = itab_new(  );
+    itab_insert_batch( itab, rows, key_ptrs, ( void ** )key_ptrs );
+    bench_record( "itab", "insert_batch", rows, rows, bench_now(  ) - t0 );
+    t0 = bench_now(  );
+    found = 0;
+    for( long i = 0; i < rows; i++ )
+        if( itab_read( itab, key_ptrs[i] ) )
+            found++;
+    bench_record( "itab", "read_batch", rows, found, bench_now(  ) - t0 );
+    itab = itab_free( itab );
+
+    // the same table with inline keys
+    t0 = bench_now(  );
+    itab = itab_new_fixed(  );
+    itab_insert_batch( itab, rows, key_ptrs, ( void ** )key_ptrs );
+    bench_record( "itab_fixed", "insert_batch", rows, rows,
+                  bench_now(  ) - t0 );
+    t0 = bench_now(  );
+    found = 0;
+    for( long i = 0; i < rows; i++ )
+        if( itab_read( itab, key_ptrs[i] ) )
+            found++;
+    bench_record( "itab_fixed", "read_batch", rows, found,
+                  bench_now(  ) - t0 );
+    itab = itab_free( itab );
+    free( key_ptrs );
+    free( keys );
+}
+
+void bench_itab( void ) {
+    for( long rows = 10; rows <= g_bench_max_rows && rows <= 10000000;
+         rows *= 10 )
+        bench_itab_size( rows );
+}
@@ -0,0 +1,79 @@
+/**
+ * @file main.c
+ * @brief driver of the benchmark suite.
+ *
+ * usage: bench [max_rows] [csv_file]
+ *
+ * max_rows limits the itab table sizes (10, 100, ... up to 10000000),
+ * single inserts are only measured up to 10000 rows,
+ * csv_file overrides the location of the UNSD data set.
+ * The result is written as JSON to stdout.
+ * If the environment variable BENCH_STATS is set, the latency histograms
+ * of the library are recorded and written as JSON to stderr.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "mem.h"
+#include "stats.h"
+#include "bench.h"
+
+#ifndef BENCH_DATA_DIR
+#define BENCH_DATA_DIR "external"
+#endif
+
+struct mem g_mem;
+
+long g_bench_max_rows = 10000;
+
+static int g_records = 0;
+
+uint64_t bench_now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( uint64_t ) ts.tv_sec * 1000000000u + ( uint64_t ) ts.tv_nsec;
+}
+
+/**
+ * @brief peak resident set size of the process in kilobytes.
+ */
+static long peak_rss_kb( void ) {
+    struct rusage ru;
+    getrusage( RUSAGE_SELF, &ru );
+    return ru.ru_maxrss;
+}
+
+void bench_record( const char *group, const char *name, long size,
+                   uint64_t ops, uint64_t ns ) {
+    double ns_per_op = ops ? ( double )ns / ( double )ops : 0.0;
+    double ops_per_sec = ns ? ( double )ops * 1e9 / ( double )ns : 0.0;
+    printf( "%s    {\"group\": \"%s\", \"name\": \"%s\", \"size\": %ld, "
+            "\"ops\": %llu, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f, "
+            "\"peak_rss_kb\": %ld}",
+            g_records ? ",\n" : "", group, name, size,
+            ( unsigned long long )ops, ns_per_op, ops_per_sec,
+            peak_rss_kb(  ) );
+    fflush( stdout );
+    g_records++;
+}
+
+int main( int argc, char **argv ) {
+    const char *csv = BENCH_DATA_DIR "/UNSD \xe2\x80\x94 Methodology.csv";
+    if( argc > 1 )
+        g_bench_max_rows = atol( argv[1] );
+    if( argc > 2 )
+        csv = argv[2];
+
+    bc_mem_init(  );
+    bc_stats_enable( getenv( "BENCH_STATS" ) != NULL );
+
+    printf( "{\n  \"benchmarks\": [\n" );
+    bench_mem(  );
+    bench_itab(  );
+    bench_unsd( csv );
+    printf( "\n  ],\n  \"peak_rss_kb\": %ld\n}\n", peak_rss_kb(  ) );
+    if( bc_stats_enabled(  ) )
+        bc_stats_dump( stderr );
+    return 0;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file mem.c
+ * @brief micro benchmarks of the memory component.
+ *
+ * Each size runs a fixed number of operations, so the numbers of two runs
+ * are directly comparable.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "mem.h"
+#include "bench.h"
+
+static const struct {
+    int size;                   ///< payload size in bytes
+    int count;                  ///< number of chunks per run
+} g_sizes[] = {
+    { 65536, 256 },
+    { 4096, 1024 },
+    { 256, 2048 },
+    { 16, 2048 },
+};
+
+static void bench_mem_size( int size, int count ) {
+    char **ptrs = malloc( count * sizeof( char * ) );
+    uint64_t t0;
+    bool ok = true;
+
+    t0 = bench_now(  );
+    for( int i = 0; i < count; i++ )
+        ptrs[i] = bc_mem_array( NULL, char, size );
+    bench_record( "mem", "alloc", size, count, bench_now(  ) - t0 );
+
+    for( int i = 0; i < count; i++ )
+        ptrs[i][0] = ( char )i;
+
+    t0 = bench_now(  );
+    for( int i = 0; i < count; i++ )
+        bc_mem_checkpoint( ptrs[i] );
+    bench_record( "mem", "checkpoint", size, count, bench_now(  ) - t0 );
+
+    t0 = bench_now(  );
+    for( int i = 0; i < count; i++ )
+        ok &= bc_mem_is_valid( ptrs[i] );
+    bench_record( "mem", "is_valid", size, count, bench_now(  ) - t0 );
+    if( !ok )
+        fprintf( stderr, "bench: invalid chunk at size %d\n", size );
+
+    t0 = bench_now(  );
+    for( int i = 0; i < count; i++ )
+        bc_mem_unlink( ptrs[i] );
+    bench_record( "mem", "unlink", size, count, bench_now(  ) - t0 );
+
+    for( int i = 0; i < count; i++ )
+        ptrs[i] = bc_mem_array( NULL, char, size / 2 );
+    t0 = bench_now(  );
+    for( int i = 0; i < count; i++ )
+        ptrs[i] = bc_mem_realloc( NULL, ptrs[i], char, size );
+    bench_record( "mem", "realloc", size, count, bench_now(  ) - t0 );
+
+    for( int i = 0; i < count; i++ )
+        bc_mem_unlink( ptrs[i] );
+
+    t0 = bench_now(  );
+    for( int i = 0; i < count; i++ )
+        ptrs[i] = bc_mem_zero_array( NULL, char, size );
+    bench_record( "mem", "zero", size, count, bench_now(  ) - t0 );
+
+    for( int i = 0; i < count; i++ )
+        bc_mem_unlink( ptrs[i] );
+
+    t0 = bench_now(  );
+    int n = bc_mem_array_batch( NULL, char, size, count, ptrs );
+    bench_record( "mem", "alloc_batch", size, n, bench_now(  ) - t0 );
+
+    t0 = bench_now(  );
+    bc_mem_unlink_batch( ptrs, n );
+    bench_record( "mem", "unlink_batch", size, n, bench_now(  ) - t0 );
+    free( ptrs );
+}
+
+void bench_mem( void ) {
+    for( size_t i = 0; i < sizeof( g_sizes ) / sizeof( g_sizes[0] ); i++ )
+        bench_mem_size( g_sizes[i].size, g_sizes[i].count );
+}
@@ -0,0 +1,118 @@
+/**
+ * @file unsd.c
+ * @brief macro benchmark loading the UNSD country list into an itab.
+ *
+ * The CSV file is read into memory once. Each round parses all lines,
+ * keys the rows by their ISO-alpha3 code and stores the country name,
+ * then looks every code up again. This is done once with generic tables
+ * and once with fixed key tables.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "mem.h"
+#include "itab.h"
+#include "bench.h"
+
+#define ROUNDS 100
+#define FIELD_COUNTRY 8
+#define FIELD_ISO3 11
+
+/**
+ * @brief reads the whole file into a NUL terminated buffer.
+ */
+static char *read_file( const char *path ) {
+    FILE *f = fopen( path, "rb" );
+    if( f == NULL )
+        return NULL;
+    fseek( f, 0, SEEK_END );
+    long size = ftell( f );
+    fseek( f, 0, SEEK_SET );
+    char *buf = malloc( size + 1 );
+    size_t n = fread( buf, 1, size, f );
+    buf[n] = 0;
+    fclose( f );
+    return buf;
+}
+
+/**
+ * @brief parses the csv text into the given itab.
+ *
+ * @param text      csv text, will not be modified
+ * @param itab      table receiving the rows
+ * @return number of rows loaded
+ */
+static long load( const char *text, t_itab itab ) {
+    long rows = 0;
+    const char *line = strchr( text, '\n' );    // skip header
+    while( line && *++line ) {
+        const char *field[FIELD_ISO3 + 1];
+        size_t len[FIELD_ISO3 + 1];
+        const char *p = line;
+        int n = 0;
+        while( n <= FIELD_ISO3 ) {
+            field[n] = p;
+            while( *p && *p != ';' && *p != '\n' && *p != '\r' )
+                p++;
+            len[n] = p - field[n];
+            n++;
+            if( *p != ';' )
+                break;
+            p++;
+        }
+        line = strchr( p, '\n' );
+        if( n <= FIELD_ISO3 || len[FIELD_ISO3] == 0 )
+            continue;
+
+        char key[8];
+        size_t kl = len[FIELD_ISO3] < sizeof( key ) ? len[FIELD_ISO3]
+                : sizeof( key ) - 1;
+        memcpy( key, field[FIELD_ISO3], kl );
+        key[kl] = 0;
+        char *name = bc_mem_array( itab, char, len[FIELD_COUNTRY] + 1 );
+        memcpy( name, field[FIELD_COUNTRY], len[FIELD_COUNTRY] );
+        name[len[FIELD_COUNTRY]] = 0;
+        bc_mem_checkpoint( name );
+        itab_insert( itab, key, name );
+        rows++;
+    }
+    return rows;
+}
+
+/**
+ * @brief loads and reads the data set ROUNDS times into fresh tables.
+ *
+ * @param fixed     use tables with inline keys
+ */
+static void bench_unsd_rounds( const char *text, bool fixed ) {
+    const char *group = fixed ? "unsd_fixed" : "unsd";
+    uint64_t load_ns = 0;
+    uint64_t read_ns = 0;
+    long rows = 0;
+    long found = 0;
+    for( int round = 0; round < ROUNDS; round++ ) {
+        uint64_t t0 = bench_now(  );
+        t_itab itab = fixed ? itab_new_fixed(  ) : itab_new(  );
+        rows = load( text, itab );
+        uint64_t t1 = bench_now(  );
+        for( t_itab_iter i = itab_foreach( itab ); i; i = itab_next( i ) )
+            if( itab_read( itab, itab_key( i ) ) )
+                found++;
+        uint64_t t2 = bench_now(  );
+        itab = itab_free( itab );
+        load_ns += t1 - t0;
+        read_ns += t2 - t1;
+    }
+    bench_record( group, "load", rows, rows * ROUNDS, load_ns );
+    bench_record( group, "lookup", rows, found, read_ns );
+}
+
+void bench_unsd( const char *path ) {
+    char *text = read_file( path );
+    if( text == NULL ) {
+        fprintf( stderr, "bench: cannot read %s\n", path );
+        return;
+    }
+    bench_unsd_rounds( text, false );
+    bench_unsd_rounds( text, true );
+    free( text );
+}
@@ -1,45 +1,213 @@
-#!/usr/bin/env tclsh 
-set fd_out {}
-set defs {}
+#!/usr/bin/env tclsh
+#
+# generates the component header <comp>.h out of a component spec.
+#
+# A spec is a Tcl script using these commands:
+#
+#   component <comp>            starts the header <comp>.h
+#   header {text}               text put in front of the structure
+#   function <fn> <desc> <in_params> <out_param> ?macros?
+#                               a member of struct <comp>. macros is the
+#                               text of its calling macros, they reach the
+#                               implementation through BC_<COMP>_CALL(<fn>).
+#                               Without it bc_<comp>_<fn> is generated.
+#   reserved <fn> <desc> <in_params> <out_param> ?macros?
+#                               a member no standard implementation provides.
+#                               Its macros use g_<comp>.<fn> and only exist
+#                               without BC_<COMP>_STATIC.
+#   footer {text}               text put behind the calling macros
+#
+# Braces of doxygen groups are written as @\{ and @\} in header and footer.
+#
+# Two compile time switches change how BC_<COMP>_CALL is bound:
+#
+#   BC_<COMP>_STATIC=<impl>   call <impl>_<fn> directly instead of going
+#                             through g_<comp>, so calls can be inlined
+#   BC_<COMP>_COUNTERS        record the latency of every call in the
+#                             histogram <comp>_<fn> of stats.h
 set cmp "<comp>"
+set spec {}
+set head {}
+set foot {}
+set members {}
+set protos {}
+set counted {}
+set macros {}
+set has_reserved 0
 
 proc name_list {params} {
     set result {}
     foreach x $params {
-        lappend result [lindex $x 1]
+        lappend result [string trimleft [lindex $x end] *]
     }
     return [join $result {, }]
 }
 
-proc function {name desc in_params out_param} {
-    global fd_out defs cmp
+# "void** p" -> "void **p", a type without a name: "void*" -> "void *"
+proc c_decl {text {named 1}} {
+    set name ""
+    if {$named} {
+        regexp {^(.*?)(\w+)$} $text -> text name
+    }
+    set base [string trimright $text "* \t"]
+    set stars [string map {" " ""} [string range $text [string length $base] end]]
+    if {$stars == ""} {return [string trim "$base $name"]}
+    return "$base $stars$name"
+}
+
+# breaks a declaration behind a comma so it fits into 80 columns, the
+# continuation lines are aligned to the opening parenthesis of the list
+proc wrap {line} {
+    if {[string length $line] < 80} {return $line}
+    set open [string last "( " $line]
+    if {$open < 0} {return $line}
+    set indent [string repeat " " [expr {$open + 2}]]
+    set result {}
+    while {[string length $line] >= 80} {
+        set cut [string last ", " [string range $line 0 78]]
+        if {$cut <= $open} {break}
+        lappend result [string range $line 0 $cut]
+        set line "$indent[string range $line [expr {$cut + 2}] end]"
+    }
+    lappend result $line
+    return [join $result "\n"]
+}
 
+proc member {name desc in_params out_param macro_text reserved} {
+    global members protos counted macros cmp has_reserved
+
+    set CMP [string toupper $cmp]
     set parnames [name_list $in_params]
-    set par [join $in_params {, }]
-    set result_type [lindex $out_param 0]
-    if {$result_type != ""}  {set result_type "($result_type)"}
-    lappend defs "#define bc_${cmp}_${name}($parnames) ${result_type}(g_${cmp}.${name}($parnames))"
-    set rtype [lindex $out_param 0]
+    set plist {}
+    foreach x $in_params {lappend plist [c_decl $x]}
+    set par [join $plist {, }]
+    if {$par == ""} {set par "void"}
+    set rtype [c_decl [lindex $out_param 0] 0]
     if {$rtype == ""} {set rtype "void"}
-    puts $fd_out "${rtype}(*$name)($par);"
+    set result_type ""
+    if {$rtype != "void"} {set result_type "([string map {" " ""} $rtype])"}
+    set rsep [expr {[string index $rtype end] == "*" ? "" : " "}]
+
+    if {$reserved} {
+        set desc "$desc (reserved)"
+        set has_reserved 1
+    }
+    lappend members "    /** $desc */"
+    lappend members [wrap "    ${rtype}${rsep}( *$name )( $par );"]
+
+    if {$reserved} {
+        set call "g_${cmp}.$name"
+    } else {
+        set call "BC_${CMP}_CALL($name)"
+        lappend protos [wrap "${rtype}${rsep}BC_${CMP}_IMPL($name)( $par );"]
+        if {$rtype == "void"} {
+            set body "    BC_${CMP}_IMPL($name)( $parnames );"
+        } else {
+            set body "    ${rtype}${rsep}r = BC_${CMP}_IMPL($name)( $parnames );"
+        }
+        lappend counted [wrap "static inline ${rtype}${rsep}bc_${cmp}_counted_${name}( $par ) \{"]
+        lappend counted "    static int id = -1;"
+        lappend counted "    uint64_t t0 = bc_stats_begin(  );"
+        lappend counted $body
+        lappend counted "    bc_stats_end( &id, \"${cmp}_${name}\", t0 );"
+        if {$rtype != "void"} {lappend counted "    return r;"}
+        lappend counted "\}"
+    }
+
+    if {$macro_text == ""} {
+        set macro_text "#define bc_${cmp}_${name}($parnames) ${result_type}(${call}($parnames))"
+    } else {
+        set macro_text [string trim $macro_text "\n"]
+    }
+    if {$reserved} {
+        set macro_text "#ifndef BC_${CMP}_STATIC\n$macro_text\n#endif"
+    }
+    lappend macros $macro_text
+}
+
+proc function {name desc in_params out_param {macro_text ""}} {
+    member $name $desc $in_params $out_param $macro_text 0
 }
-    
 
+proc reserved {name desc in_params out_param {macro_text ""}} {
+    member $name $desc $in_params $out_param $macro_text 1
+}
 
 proc component {name} {
-    global fd_out cmp
+    global cmp
     set cmp $name
-    if {$fd_out != ""} { close $fd_out }
-    set fd_out [open "$name.h" w]
-    puts $fd_out "extern struct $name \{"
+}
+
+proc header {text} {
+    global head
+    set head [string map {"\\{" "{" "\\}" "}"} [string trim $text "\n"]]
+}
+
+proc footer {text} {
+    global foot
+    set foot [string map {"\\{" "{" "\\}" "}"} [string trim $text "\n"]]
 }
 
 foreach arg $argv {
+    set spec [file tail $arg]
     source $arg
 }
 
-puts $fd_out "\}        g_$cmp;"
-foreach x $defs {
-    puts $fd_out $x
+set CMP [string toupper $cmp]
+set fd_out [open "$cmp.h" w]
+puts $fd_out "/* generated by gen.tcl from $spec, do not edit */"
+puts $fd_out "#ifndef ${CMP}_H"
+puts $fd_out "#define ${CMP}_H"
+if {$head != ""} {
+    puts $fd_out $head
+    puts $fd_out ""
+}
+puts $fd_out "/**
+* @brief the functions a $cmp component implements
+*/
+struct $cmp \{"
+puts $fd_out [join $members "\n"]
+puts $fd_out "\};
+
+/**
+* the component in use, filled in by its init function
+*/
+extern struct $cmp g_$cmp;
+
+/**
+* @brief binds the calling macros to an implementation.
+*
+* By default every call goes through g_$cmp, so the implementation can be
+* exchanged at runtime. When BC_${CMP}_STATIC is defined to the prefix of an
+* implementation (e.g. ${cmp}_std), the macros call <prefix>_<fn> directly.
+* The compiler can then inline these calls like any other function.
+* With BC_${CMP}_COUNTERS the latency of every call is recorded in the stats
+* histogram ${cmp}_<fn>, see stats.h.[expr {$has_reserved ? "
+* Reserved members have no standard implementation, their macros always
+* go through g_$cmp and do not exist with BC_${CMP}_STATIC." : ""}]
+*/
+#ifdef BC_${CMP}_STATIC
+#define BC_${CMP}_CAT_(a, b) a ## b
+#define BC_${CMP}_CAT(a, b) BC_${CMP}_CAT_(a, b)
+#define BC_${CMP}_IMPL(fn) BC_${CMP}_CAT(BC_${CMP}_STATIC, _ ## fn)"
+puts $fd_out [join $protos "\n"]
+puts $fd_out "#else
+#define BC_${CMP}_IMPL(fn) g_${cmp}.fn
+#endif
+"
+puts $fd_out "#ifdef BC_${CMP}_COUNTERS"
+puts $fd_out "#include \"stats.h\""
+puts $fd_out [join $counted "\n"]
+puts $fd_out "#define BC_${CMP}_CALL(fn) bc_${cmp}_counted_ ## fn
+#else
+#define BC_${CMP}_CALL(fn) BC_${CMP}_IMPL(fn)
+#endif
+"
+puts $fd_out [join $macros "\n\n"]
+if {$foot != ""} {
+    puts $fd_out ""
+    puts $fd_out $foot
 }
+puts $fd_out ""
+puts $fd_out "#endif"
 close $fd_out
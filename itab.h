@@ -1,14 +1,30 @@
 #ifndef ITAB_H
 #define ITAB_H
+#include <stdbool.h>
+
+/** longest key of a table created by itab_new_fixed */
+#define ITAB_FIXED_KEY_MAX 15
 
 typedef struct itab *t_itab;
 typedef struct itab_iter* t_itab_iter;
+/** receives the values of two rows with equal keys */
+typedef void (*itab_join_fn)(const char *key, void *left, void *right, void *user);
 
 unsigned itab_lines(struct itab *itab);
 struct itab *itab_new(void);
+struct itab *itab_new_fixed(void);
 int itab_entry_cmp(const void *aptr, const void *bptr);
-void itab_insert(struct itab *itab, const char *key, void *value);
+bool itab_insert(struct itab *itab, const char *key, void *value);
+bool itab_insert_batch(struct itab *itab, unsigned n, const char **keys, void **values);
 void *itab_read(struct itab *itab, const char *key);
+bool itab_delete(struct itab *itab, const char *key);
+bool itab_update(struct itab *itab, const char *key, void *value);
+bool itab_upsert(struct itab *itab, const char *key, void *value);
+void itab_join(struct itab *a, struct itab *b, itab_join_fn fn, void *user);
+void itab_join_parallel(struct itab *a, struct itab *b, unsigned threads, itab_join_fn fn, void *user);
+struct itab *itab_intersect(struct itab *a, struct itab *b);
+struct itab *itab_difference(struct itab *a, struct itab *b);
+struct itab *itab_union(struct itab *a, struct itab *b);
 void itab_dump(struct itab *itab);
 struct itab_iter *itab_foreach(struct itab *tab);
 struct itab_iter *itab_next(struct itab_iter *iter);
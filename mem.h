@@ -1,3 +1,6 @@
+/* generated by gen.tcl from mem.spec.tcl, do not edit */
+#ifndef MEM_H
+#define MEM_H
 /**
 * @file mem.h
 * @brief defines all memory component related stuff.
@@ -6,9 +9,8 @@
 * only a structure of function pointers is defined and a set of defines to call them properly.
 */
 
-#ifndef MEM_H
-#define MEM_H
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 /**
 * @defgroup mem Memory Management
@@ -27,56 +29,397 @@
 */
 
 /**
-* @brief the structure defines the functions a memory components needs to implement
+* @brief callback raised when a context exceeds the soft limit of its budget.
+*
+* @param ctx    context the budget is attached to
+* @param used   bytes currently charged to the budget
+* @param limit  the soft limit
+* @param user   user data given with bc_mem_budget
+*/
+typedef void ( *bc_mem_budget_fn )( void *ctx, size_t used, size_t limit,
+                                    void *user );
+
+/**
+* @brief kinds of violations found by the scrubber
+*/
+enum bc_mem_violation {
+    BC_MEM_CORRUPTED,   ///< header or sentinel magic is broken
+    BC_MEM_MODIFIED,    ///< content differs from the last checkpoint
+};
+
+/**
+* @brief callback of the scrubber for each violation found.
+*
+* @param ptr    the chunk
+* @param kind   one of enum bc_mem_violation
+* @param file   where the chunk was allocated
+* @param line   where the chunk was allocated
+* @param user   user data given with bc_mem_scrub_start
+*/
+typedef void ( *bc_mem_scrub_fn )( void *ptr, int kind, const char *file,
+                                   int line, void *user );
+
+/**
+* @brief usage numbers of the pool of a registered type
+*/
+struct bc_mem_type_stats {
+    const char *name;   ///< name given at registration
+    size_t size;        ///< size of one object
+    size_t live;        ///< objects in use
+    size_t pooled;      ///< released objects kept for reuse
+    size_t slabs;       ///< contiguous blocks allocated for the pool
+};
+
+/**
+* @brief the functions a mem component implements
 */
 struct mem {
-    /** free memory */
-    int ( *free ) ( void *ptr );
-    /** getting the type of the chunk */
-    void *( *get_type ) ( void *ptr, int type );
-    /** allocating memory */
-    void *( *realloc ) ( void *ctx, void *p, int type, int count,
-                         const char *file, int line );
-    /** increasing usage counter */
-    void *( *link ) ( void *src, void *target );
-    /** decreasing usage counter */
-    void *( *unlink ) ( void *ptr, const char *file, int line );
-
-
-    /** create checkpoint */
+    /** Free a chunk of memory. (reserved) */
+    int ( *free )( void *ptr );
+    /** Get a typed pointer out of a pointer. */
+    void *( *get_type )( void *ptr, int type );
+    /** Register a type with its own pool. */
+    int ( *register_type )( const char *name, size_t size );
+    /** Allocate an object of a registered type. */
+    void *( *alloc_typed )( void *ctx, int type, const char *file, int line );
+    /** Usage numbers of a registered type. */
+    bool ( *type_stats )( int type, struct bc_mem_type_stats *stats );
+    /** Change the size of a array. */
+    void *( *realloc )( void *ctx, void *p, int type, int count,
+                        const char *file, int line );
+    /** Allocate an uninitialized array. */
+    void *( *alloc )( void *ctx, int type, int count, const char *file,
+                      int line );
+    /** Allocate a zero initialized array. */
+    void *( *zero )( void *ctx, int type, int count, const char *file,
+                     int line );
+    /** Allocate a zero initialized array with write tracking. */
+    void *( *guarded )( void *ctx, int type, int count, const char *file,
+                        int line );
+    /** Allocate n arrays at once. */
+    int ( *alloc_batch )( void *ctx, int type, int count, int n, void **out,
+                          const char *file, int line );
+    /** Create an additional talloc parent to a pointer. (reserved) */
+    void *( *link )( void *src, void *target );
+    /** remove assocation and eventually free memory */
+    void *( *unlink )( void *ptr, const char *file, int line );
+    /** remove assocations of n chunks at once */
+    void ( *unlink_batch )( void **ptrs, int n, const char *file, int line );
+    /** Attach a memory budget to a context. */
+    void ( *budget )( void *ctx, size_t soft, size_t hard,
+                      bc_mem_budget_fn fn, void *user );
+    /** Memory charged to the budget of a context. */
+    size_t ( *usage )( void *ctx );
+    /** Create a checkpoint of a chunk. */
     void ( *checkpoint )( void *ptr, const char *file, int line );
-    /** check validity */
+    /** Check the validity of a chunk. */
     bool ( *is_valid )( void *ptr );
-
-    void (*report)(void); /** < reporting of the current memory status */
+    /** Report the current memory status. */
+    void ( *report )( void );
+    /** Start integrity checking. */
+    bool ( *scrub_start )( unsigned rate, bc_mem_scrub_fn fn, void *user );
+    /** Stop integrity checking. */
+    void ( *scrub_stop )( void );
+    /** Check the next chunks in the calling thread. */
+    unsigned ( *scrub_step )( unsigned count );
 };
 
 /**
-* there is one memory management component centrally defined.
-* we are referencing this.
+* the component in use, filled in by its init function
 */
 extern struct mem g_mem;
 
+/**
+* @brief binds the calling macros to an implementation.
+*
+* By default every call goes through g_mem, so the implementation can be
+* exchanged at runtime. When BC_MEM_STATIC is defined to the prefix of an
+* implementation (e.g. mem_std), the macros call <prefix>_<fn> directly.
+* The compiler can then inline these calls like any other function.
+* With BC_MEM_COUNTERS the latency of every call is recorded in the stats
+* histogram mem_<fn>, see stats.h.
+* Reserved members have no standard implementation, their macros always
+* go through g_mem and do not exist with BC_MEM_STATIC.
+*/
+#ifdef BC_MEM_STATIC
+#define BC_MEM_CAT_(a, b) a ## b
+#define BC_MEM_CAT(a, b) BC_MEM_CAT_(a, b)
+#define BC_MEM_IMPL(fn) BC_MEM_CAT(BC_MEM_STATIC, _ ## fn)
+void *BC_MEM_IMPL(get_type)( void *ptr, int type );
+int BC_MEM_IMPL(register_type)( const char *name, size_t size );
+void *BC_MEM_IMPL(alloc_typed)( void *ctx, int type, const char *file,
+                                int line );
+bool BC_MEM_IMPL(type_stats)( int type, struct bc_mem_type_stats *stats );
+void *BC_MEM_IMPL(realloc)( void *ctx, void *p, int type, int count,
+                            const char *file, int line );
+void *BC_MEM_IMPL(alloc)( void *ctx, int type, int count, const char *file,
+                          int line );
+void *BC_MEM_IMPL(zero)( void *ctx, int type, int count, const char *file,
+                         int line );
+void *BC_MEM_IMPL(guarded)( void *ctx, int type, int count, const char *file,
+                            int line );
+int BC_MEM_IMPL(alloc_batch)( void *ctx, int type, int count, int n,
+                              void **out, const char *file, int line );
+void *BC_MEM_IMPL(unlink)( void *ptr, const char *file, int line );
+void BC_MEM_IMPL(unlink_batch)( void **ptrs, int n, const char *file,
+                                int line );
+void BC_MEM_IMPL(budget)( void *ctx, size_t soft, size_t hard,
+                          bc_mem_budget_fn fn, void *user );
+size_t BC_MEM_IMPL(usage)( void *ctx );
+void BC_MEM_IMPL(checkpoint)( void *ptr, const char *file, int line );
+bool BC_MEM_IMPL(is_valid)( void *ptr );
+void BC_MEM_IMPL(report)( void );
+bool BC_MEM_IMPL(scrub_start)( unsigned rate, bc_mem_scrub_fn fn, void *user );
+void BC_MEM_IMPL(scrub_stop)( void );
+unsigned BC_MEM_IMPL(scrub_step)( unsigned count );
+#else
+#define BC_MEM_IMPL(fn) g_mem.fn
+#endif
+
+#ifdef BC_MEM_COUNTERS
+#include "stats.h"
+static inline void *bc_mem_counted_get_type( void *ptr, int type ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    void *r = BC_MEM_IMPL(get_type)( ptr, type );
+    bc_stats_end( &id, "mem_get_type", t0 );
+    return r;
+}
+static inline int bc_mem_counted_register_type( const char *name,
+                                                size_t size ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    int r = BC_MEM_IMPL(register_type)( name, size );
+    bc_stats_end( &id, "mem_register_type", t0 );
+    return r;
+}
+static inline void *bc_mem_counted_alloc_typed( void *ctx, int type,
+                                                const char *file, int line ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    void *r = BC_MEM_IMPL(alloc_typed)( ctx, type, file, line );
+    bc_stats_end( &id, "mem_alloc_typed", t0 );
+    return r;
+}
+static inline bool bc_mem_counted_type_stats( int type,
+                                              struct bc_mem_type_stats *stats ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    bool r = BC_MEM_IMPL(type_stats)( type, stats );
+    bc_stats_end( &id, "mem_type_stats", t0 );
+    return r;
+}
+static inline void *bc_mem_counted_realloc( void *ctx, void *p, int type,
+                                            int count, const char *file,
+                                            int line ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    void *r = BC_MEM_IMPL(realloc)( ctx, p, type, count, file, line );
+    bc_stats_end( &id, "mem_realloc", t0 );
+    return r;
+}
+static inline void *bc_mem_counted_alloc( void *ctx, int type, int count,
+                                          const char *file, int line ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    void *r = BC_MEM_IMPL(alloc)( ctx, type, count, file, line );
+    bc_stats_end( &id, "mem_alloc", t0 );
+    return r;
+}
+static inline void *bc_mem_counted_zero( void *ctx, int type, int count,
+                                         const char *file, int line ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    void *r = BC_MEM_IMPL(zero)( ctx, type, count, file, line );
+    bc_stats_end( &id, "mem_zero", t0 );
+    return r;
+}
+static inline void *bc_mem_counted_guarded( void *ctx, int type, int count,
+                                            const char *file, int line ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    void *r = BC_MEM_IMPL(guarded)( ctx, type, count, file, line );
+    bc_stats_end( &id, "mem_guarded", t0 );
+    return r;
+}
+static inline int bc_mem_counted_alloc_batch( void *ctx, int type, int count,
+                                              int n, void **out,
+                                              const char *file, int line ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    int r = BC_MEM_IMPL(alloc_batch)( ctx, type, count, n, out, file, line );
+    bc_stats_end( &id, "mem_alloc_batch", t0 );
+    return r;
+}
+static inline void *bc_mem_counted_unlink( void *ptr, const char *file,
+                                           int line ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    void *r = BC_MEM_IMPL(unlink)( ptr, file, line );
+    bc_stats_end( &id, "mem_unlink", t0 );
+    return r;
+}
+static inline void bc_mem_counted_unlink_batch( void **ptrs, int n,
+                                                const char *file, int line ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    BC_MEM_IMPL(unlink_batch)( ptrs, n, file, line );
+    bc_stats_end( &id, "mem_unlink_batch", t0 );
+}
+static inline void bc_mem_counted_budget( void *ctx, size_t soft, size_t hard,
+                                          bc_mem_budget_fn fn, void *user ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    BC_MEM_IMPL(budget)( ctx, soft, hard, fn, user );
+    bc_stats_end( &id, "mem_budget", t0 );
+}
+static inline size_t bc_mem_counted_usage( void *ctx ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    size_t r = BC_MEM_IMPL(usage)( ctx );
+    bc_stats_end( &id, "mem_usage", t0 );
+    return r;
+}
+static inline void bc_mem_counted_checkpoint( void *ptr, const char *file,
+                                              int line ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    BC_MEM_IMPL(checkpoint)( ptr, file, line );
+    bc_stats_end( &id, "mem_checkpoint", t0 );
+}
+static inline bool bc_mem_counted_is_valid( void *ptr ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    bool r = BC_MEM_IMPL(is_valid)( ptr );
+    bc_stats_end( &id, "mem_is_valid", t0 );
+    return r;
+}
+static inline void bc_mem_counted_report( void ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    BC_MEM_IMPL(report)(  );
+    bc_stats_end( &id, "mem_report", t0 );
+}
+static inline bool bc_mem_counted_scrub_start( unsigned rate,
+                                               bc_mem_scrub_fn fn,
+                                               void *user ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    bool r = BC_MEM_IMPL(scrub_start)( rate, fn, user );
+    bc_stats_end( &id, "mem_scrub_start", t0 );
+    return r;
+}
+static inline void bc_mem_counted_scrub_stop( void ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    BC_MEM_IMPL(scrub_stop)(  );
+    bc_stats_end( &id, "mem_scrub_stop", t0 );
+}
+static inline unsigned bc_mem_counted_scrub_step( unsigned count ) {
+    static int id = -1;
+    uint64_t t0 = bc_stats_begin(  );
+    unsigned r = BC_MEM_IMPL(scrub_step)( count );
+    bc_stats_end( &id, "mem_scrub_step", t0 );
+    return r;
+}
+#define BC_MEM_CALL(fn) bc_mem_counted_ ## fn
+#else
+#define BC_MEM_CALL(fn) BC_MEM_IMPL(fn)
+#endif
+
+#ifndef BC_MEM_STATIC
+#define bc_mem_free(ptr) (int)(g_mem.free(ptr))
+#endif
+
+/**
+* @brief getting the type of a memory chunk
+*
+* this is a checked downcast: the pointer is returned if the chunk holds
+* an object of the registered type, otherwise NULL.
+*/
+#define bc_mem_get_type(ptr, type) (void*)(BC_MEM_CALL(get_type)(ptr, type))
+
+/**
+* @brief registers a C type and returns its type id.
+*
+* objects of a registered type come from a pool of their own, so they are
+* contiguous in memory. Registering the same type again returns the same id.
+*/
+#define bc_mem_register_type(type) (BC_MEM_CALL(register_type)(#type, sizeof(type)))
+
+/**
+* @brief allocates an object of a registered type
+*
+* the content is not initialized.
+*/
+#define bc_mem_alloc_typed(ctx, type_id) (void*)(BC_MEM_CALL(alloc_typed)(ctx, type_id, __FILE__, __LINE__))
+
+/**
+* @brief fills stats with the usage numbers of a registered type
+*/
+#define bc_mem_type_stats(type, stats) (BC_MEM_CALL(type_stats)(type, stats))
+
 /**
 * @brief main call to allocate memory or eventually reallocate memory.
+*
+* the old content of p is kept, everything beyond it is zeroed.
+* Without p the whole array is zeroed.
 */
-#define bc_mem_realloc(ctx, p, type, count) (void*)(g_mem.realloc(ctx, p, sizeof(type), count, __FILE__, __LINE__))
+#define bc_mem_realloc(ctx, p, type, count) (void*)(BC_MEM_CALL(realloc)(ctx, p, sizeof(type), count, __FILE__, __LINE__))
 
 /**
 * @brief allocates a single structure
+*
+* the content is not initialized.
 */
-#define bc_mem_alloc(ctx, type) (void*)(g_mem.realloc(ctx, NULL, sizeof(type), 1, __FILE__, __LINE__))
+#define bc_mem_alloc(ctx, type) (void*)(BC_MEM_CALL(alloc)(ctx, sizeof(type), 1, __FILE__, __LINE__))
 
 /**
 * @brief allocates an array of a single type
+*
+* the content is not initialized.
 */
-#define bc_mem_array(ctx, type, count) (void*)(g_mem.realloc(ctx, NULL, sizeof(type), count, __FILE__, __LINE__))
+#define bc_mem_array(ctx, type, count) (void*)(BC_MEM_CALL(alloc)(ctx, sizeof(type), count, __FILE__, __LINE__))
 
 /**
-* @brief getting the type of a memory chunk
+* @brief allocates a single zero initialized structure
 */
-#define bc_mem_get_type(ptr, type) (void*)(g_mem.get_type(ptr, type))
+#define bc_mem_zero(ctx, type) (void*)(BC_MEM_CALL(zero)(ctx, sizeof(type), 1, __FILE__, __LINE__))
 
+/**
+* @brief allocates a zero initialized array of a single type
+*/
+#define bc_mem_zero_array(ctx, type, count) (void*)(BC_MEM_CALL(zero)(ctx, sizeof(type), count, __FILE__, __LINE__))
+
+/**
+* @brief allocates a zero initialized array with write tracking
+*
+* the array lives on its own write protected pages. After a checkpoint
+* the first write to it is caught, so bc_mem_is_valid can tell in O(1)
+* whether it has been changed. Meant for large, mostly immutable buffers.
+*
+* Only writes of the process itself are caught. A system call writing into
+* a protected array, e.g. read(fd, ptr, n), fails with EFAULT instead, so
+* fill the array before bc_mem_checkpoint protects it.
+*/
+#define bc_mem_guarded_array(ctx, type, count) (void*)(BC_MEM_CALL(guarded)(ctx, sizeof(type), count, __FILE__, __LINE__))
+
+/**
+* @brief allocates n single structures at once
+*
+* the pointers are stored in out[0..n-1]. This is much cheaper than n calls
+* of bc_mem_alloc, since size calculation, free list search and context
+* lookup are done only once.
+* @returns the number of structures allocated
+*/
+#define bc_mem_alloc_batch(ctx, type, n, out) (BC_MEM_CALL(alloc_batch)(ctx, sizeof(type), 1, n, (void**)(out), __FILE__, __LINE__))
+
+/**
+* @brief allocates n arrays of the same type and length at once
+*/
+#define bc_mem_array_batch(ctx, type, count, n, out) (BC_MEM_CALL(alloc_batch)(ctx, sizeof(type), count, n, (void**)(out), __FILE__, __LINE__))
+
+#ifndef BC_MEM_STATIC
 /**
 * @brief adding a link to a memory chunk
 *
@@ -84,13 +427,36 @@ extern struct mem g_mem;
 * this memory if the reference count goes to 0.
 */
 #define bc_mem_link(src, target) (void*)(g_mem.link(src, target))
+#endif
 
 /**
 * @brief reduce the usage counter of a memory chunk.
 *
 * if the usage goes to 0, this memory is freed.
 */
-#define bc_mem_unlink(ptr) (g_mem.unlink((void**)(ptr), __FILE__, __LINE__))
+#define bc_mem_unlink(ptr) (BC_MEM_CALL(unlink)((void**)(ptr), __FILE__, __LINE__))
+
+/**
+* @brief reduce the usage counter of n memory chunks in a single pass.
+*
+* every entry of ptrs is set to NULL afterwards.
+*/
+#define bc_mem_unlink_batch(ptrs, n) (BC_MEM_CALL(unlink_batch)((void**)(ptrs), n, __FILE__, __LINE__))
+
+/**
+* @brief attaches a memory budget to a context.
+*
+* The context and everything allocated in it or in its descendants is
+* charged with the pages it occupies. Above the soft limit fn is called
+* once, above the hard limit allocations fail and return NULL.
+* A limit of 0 means no limit. Calling it again changes the limits.
+*/
+#define bc_mem_budget(ctx, soft, hard, fn, user) (BC_MEM_CALL(budget)(ctx, soft, hard, fn, user))
+
+/**
+* @brief bytes currently charged to the budget ctx belongs to, in O(1).
+*/
+#define bc_mem_usage(ctx) (BC_MEM_CALL(usage)(ctx))
 
 /**
 * @brief creates a checkpoint of this memory chunk. 
@@ -98,16 +464,54 @@ extern struct mem g_mem;
 * Every change that is performed
 * subsequent to the checkpoint is recognized
 */
-#define bc_mem_checkpoint(ptr) (g_mem.checkpoint(ptr, __FILE__, __LINE__))
+#define bc_mem_checkpoint(ptr) (BC_MEM_CALL(checkpoint)(ptr, __FILE__, __LINE__))
 
 /**
 * @brief check if the structure is valid.
 * there are several levels of validity:
 * - The header and sentinel magic areas are intact
 * - the checksum over internal data is equal to the save one from the previous checkpoint
+*
+* uninitialized memory from bc_mem_alloc is not checksummed before its first checkpoint.
 */
-#define bc_mem_is_valid(ptr) (g_mem.is_valid(ptr))
+#define bc_mem_is_valid(ptr) (BC_MEM_CALL(is_valid)(ptr))
 
+/**
+ * @brief reports the memory usage for each individual chunk
+ */
+#define bc_mem_report() (BC_MEM_CALL(report)())
+
+/**
+ * @brief starts checking the integrity of all chunks.
+ *
+ * Corrupted magic and, for chunks with a checkpoint, modified content is
+ * reported through fn together with the allocation site. With a rate
+ * above 0 a background thread checks rate chunks per second, otherwise
+ * chunks are only checked by bc_mem_scrub_step. The checksums are
+ * computed without holding the lock of the memory manager, so other
+ * threads are only held up while the next few chunks are picked.
+ *
+ * The memory manager takes no lock until the scrubber is started for the
+ * first time, from then on every call is serialized. Start it before
+ * other threads use the memory manager.
+ */
+#define bc_mem_scrub_start(rate, fn, user) (BC_MEM_CALL(scrub_start)(rate, fn, user))
+
+/**
+ * @brief stops the scrubber and its thread.
+ */
+#define bc_mem_scrub_stop() (BC_MEM_CALL(scrub_stop)())
+
+/**
+ * @brief checks the next count chunks in the calling thread.
+ *
+ * Violations are reported through the fn given to bc_mem_scrub_start,
+ * before this returns. A call ends at the end of the chunk list, the next
+ * one starts over at its beginning. Nothing is checked while the scrubber
+ * is stopped.
+ * @returns the number of violations reported
+ */
+#define bc_mem_scrub_step(count) (BC_MEM_CALL(scrub_step)(count))
 
 /**
  * @brief strdup, with additional handling of the memory context
@@ -116,18 +520,13 @@ extern struct mem g_mem;
 inline static char *bc_mem_strdup( void *ctx, const char *str ) {
     size_t l = strlen( str );
     char *result = bc_mem_array( ctx, char, l + 1 );
+    if( result == NULL )
+        return NULL;
     memcpy( result, str, l + 1 );
     bc_mem_checkpoint(result);
     return result;
 }
 
-
-/**
- * @brief reports the memory usage for each individual chunk
- */
-#define bc_mem_report() (g_mem.report()) 
-
-
 /**
  * @brief initializes the memory manager and does the setup for the function calls.
  */
@@ -137,6 +536,4 @@ extern void bc_mem_init(void);
 * @}
 */
 
-
-
 #endif
@@ -1,11 +1,184 @@
 component mem
-# function array          {Allocate an array}                                 {{void* ctx} {int type} {int count}}                {void* ptr}
+header {
+/**
+* @file mem.h
+* @brief defines all memory component related stuff.
+*
+* This is using an abstract way of calling components.
+* only a structure of function pointers is defined and a set of defines to call them properly.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+/**
+* @defgroup mem Memory Management
+*
+* Memory management is used as a global component. The concrete implementation is hidden from the callers.
+* this could be a very simple implementation or one that is really doing some garbage collection.
+*
+* @startuml
+* Client -> Memory : init
+* Client -> Memory : realloc
+* Client -> Memory : free
+* Client -> Memory : usage report
+* @enduml
+*
+* @\{
+*/
+
+/**
+* @brief callback raised when a context exceeds the soft limit of its budget.
+*
+* @param ctx    context the budget is attached to
+* @param used   bytes currently charged to the budget
+* @param limit  the soft limit
+* @param user   user data given with bc_mem_budget
+*/
+typedef void ( *bc_mem_budget_fn )( void *ctx, size_t used, size_t limit,
+                                    void *user );
+
+/**
+* @brief kinds of violations found by the scrubber
+*/
+enum bc_mem_violation {
+    BC_MEM_CORRUPTED,   ///< header or sentinel magic is broken
+    BC_MEM_MODIFIED,    ///< content differs from the last checkpoint
+};
+
+/**
+* @brief callback of the scrubber for each violation found.
+*
+* @param ptr    the chunk
+* @param kind   one of enum bc_mem_violation
+* @param file   where the chunk was allocated
+* @param line   where the chunk was allocated
+* @param user   user data given with bc_mem_scrub_start
+*/
+typedef void ( *bc_mem_scrub_fn )( void *ptr, int kind, const char *file,
+                                   int line, void *user );
+
+/**
+* @brief usage numbers of the pool of a registered type
+*/
+struct bc_mem_type_stats {
+    const char *name;   ///< name given at registration
+    size_t size;        ///< size of one object
+    size_t live;        ///< objects in use
+    size_t pooled;      ///< released objects kept for reuse
+    size_t slabs;       ///< contiguous blocks allocated for the pool
+};
+}
+
 # function asprintf       {Format a string given a va_list}                   {{char* str} {char* fmt} {va_list ap}}              {}
 # function enable_leak_report
-function free           {Free a chunk of memory.}                           {{void* ptr}}                                       {int rc}
-function get_type       {Get a typed pointer out of a pointer.}             {{void* ptr} {int type}}                            {void* ptr}
-function realloc        {Change the size of a array.}                       {{void* ctx} {void* p} {int type} {int count}}      {void* ptr}
-function link           {Create an additional talloc parent to a pointer.}  {{void* src} {void* target}}                        {void* result}
+reserved free       {Free a chunk of memory.}                           {{void* ptr}}                                       {int rc}
+function get_type       {Get a typed pointer out of a pointer.}             {{void* ptr} {int type}}                            {void* ptr} {
+/**
+* @brief getting the type of a memory chunk
+*
+* this is a checked downcast: the pointer is returned if the chunk holds
+* an object of the registered type, otherwise NULL.
+*/
+#define bc_mem_get_type(ptr, type) (void*)(BC_MEM_CALL(get_type)(ptr, type))
+}
+function register_type  {Register a type with its own pool.}                {{const char* name} {size_t size}}                  {int type} {
+/**
+* @brief registers a C type and returns its type id.
+*
+* objects of a registered type come from a pool of their own, so they are
+* contiguous in memory. Registering the same type again returns the same id.
+*/
+#define bc_mem_register_type(type) (BC_MEM_CALL(register_type)(#type, sizeof(type)))
+}
+function alloc_typed    {Allocate an object of a registered type.}          {{void* ctx} {int type} {const char* file} {int line}} {void* ptr} {
+/**
+* @brief allocates an object of a registered type
+*
+* the content is not initialized.
+*/
+#define bc_mem_alloc_typed(ctx, type_id) (void*)(BC_MEM_CALL(alloc_typed)(ctx, type_id, __FILE__, __LINE__))
+}
+function type_stats     {Usage numbers of a registered type.}               {{int type} {struct bc_mem_type_stats* stats}}      {bool found} {
+/**
+* @brief fills stats with the usage numbers of a registered type
+*/
+#define bc_mem_type_stats(type, stats) (BC_MEM_CALL(type_stats)(type, stats))
+}
+function realloc        {Change the size of a array.}                       {{void* ctx} {void* p} {int type} {int count} {const char* file} {int line}} {void* ptr} {
+/**
+* @brief main call to allocate memory or eventually reallocate memory.
+*
+* the old content of p is kept, everything beyond it is zeroed.
+* Without p the whole array is zeroed.
+*/
+#define bc_mem_realloc(ctx, p, type, count) (void*)(BC_MEM_CALL(realloc)(ctx, p, sizeof(type), count, __FILE__, __LINE__))
+}
+function alloc          {Allocate an uninitialized array.}                  {{void* ctx} {int type} {int count} {const char* file} {int line}} {void* ptr} {
+/**
+* @brief allocates a single structure
+*
+* the content is not initialized.
+*/
+#define bc_mem_alloc(ctx, type) (void*)(BC_MEM_CALL(alloc)(ctx, sizeof(type), 1, __FILE__, __LINE__))
+
+/**
+* @brief allocates an array of a single type
+*
+* the content is not initialized.
+*/
+#define bc_mem_array(ctx, type, count) (void*)(BC_MEM_CALL(alloc)(ctx, sizeof(type), count, __FILE__, __LINE__))
+}
+function zero           {Allocate a zero initialized array.}                {{void* ctx} {int type} {int count} {const char* file} {int line}} {void* ptr} {
+/**
+* @brief allocates a single zero initialized structure
+*/
+#define bc_mem_zero(ctx, type) (void*)(BC_MEM_CALL(zero)(ctx, sizeof(type), 1, __FILE__, __LINE__))
+
+/**
+* @brief allocates a zero initialized array of a single type
+*/
+#define bc_mem_zero_array(ctx, type, count) (void*)(BC_MEM_CALL(zero)(ctx, sizeof(type), count, __FILE__, __LINE__))
+}
+function guarded        {Allocate a zero initialized array with write tracking.} {{void* ctx} {int type} {int count} {const char* file} {int line}} {void* ptr} {
+/**
+* @brief allocates a zero initialized array with write tracking
+*
+* the array lives on its own write protected pages. After a checkpoint
+* the first write to it is caught, so bc_mem_is_valid can tell in O(1)
+* whether it has been changed. Meant for large, mostly immutable buffers.
+*
+* Only writes of the process itself are caught. A system call writing into
+* a protected array, e.g. read(fd, ptr, n), fails with EFAULT instead, so
+* fill the array before bc_mem_checkpoint protects it.
+*/
+#define bc_mem_guarded_array(ctx, type, count) (void*)(BC_MEM_CALL(guarded)(ctx, sizeof(type), count, __FILE__, __LINE__))
+}
+function alloc_batch    {Allocate n arrays at once.}                        {{void* ctx} {int type} {int count} {int n} {void** out} {const char* file} {int line}} {int done} {
+/**
+* @brief allocates n single structures at once
+*
+* the pointers are stored in out[0..n-1]. This is much cheaper than n calls
+* of bc_mem_alloc, since size calculation, free list search and context
+* lookup are done only once.
+* @returns the number of structures allocated
+*/
+#define bc_mem_alloc_batch(ctx, type, n, out) (BC_MEM_CALL(alloc_batch)(ctx, sizeof(type), 1, n, (void**)(out), __FILE__, __LINE__))
+
+/**
+* @brief allocates n arrays of the same type and length at once
+*/
+#define bc_mem_array_batch(ctx, type, count, n, out) (BC_MEM_CALL(alloc_batch)(ctx, sizeof(type), count, n, (void**)(out), __FILE__, __LINE__))
+}
+reserved link       {Create an additional talloc parent to a pointer.}  {{void* src} {void* target}}                        {void* result} {
+/**
+* @brief adding a link to a memory chunk
+*
+* this introduces reference counting. An unlink would only free
+* this memory if the reference count goes to 0.
+*/
+#define bc_mem_link(src, target) (void*)(g_mem.link(src, target))
+}
 #function report_depth_file {} {} {}
 #function set_abort_fn
 #function set_log_stderr
@@ -13,6 +186,122 @@ function link           {Create an additional talloc parent to a pointer.}  {{vo
 #function steal
 # function strdup         {copy string into local memory}                     {{void* Context} {char* String}}                    {char* String}
 # function strdup_append  {append chars to memory string}                     {{char* target} {char* src}}                        {}
-function unlink         {remove assocation and eventually free memory}      {{void* ptr}}                                       {}
-# function zero           {Allocate a 0-initizialized structure.}             {{void* ctx} {int type}}                            {void*}
-# function zero_array     {Allocate a zero initialized array}                 {{void* ctx} {int type} {int count}}                {void*}
+function unlink         {remove assocation and eventually free memory}      {{void* ptr} {const char* file} {int line}}         {void* ptr} {
+/**
+* @brief reduce the usage counter of a memory chunk.
+*
+* if the usage goes to 0, this memory is freed.
+*/
+#define bc_mem_unlink(ptr) (BC_MEM_CALL(unlink)((void**)(ptr), __FILE__, __LINE__))
+}
+function unlink_batch   {remove assocations of n chunks at once}            {{void** ptrs} {int n} {const char* file} {int line}} {} {
+/**
+* @brief reduce the usage counter of n memory chunks in a single pass.
+*
+* every entry of ptrs is set to NULL afterwards.
+*/
+#define bc_mem_unlink_batch(ptrs, n) (BC_MEM_CALL(unlink_batch)((void**)(ptrs), n, __FILE__, __LINE__))
+}
+function budget         {Attach a memory budget to a context.}              {{void* ctx} {size_t soft} {size_t hard} {bc_mem_budget_fn fn} {void* user}} {} {
+/**
+* @brief attaches a memory budget to a context.
+*
+* The context and everything allocated in it or in its descendants is
+* charged with the pages it occupies. Above the soft limit fn is called
+* once, above the hard limit allocations fail and return NULL.
+* A limit of 0 means no limit. Calling it again changes the limits.
+*/
+#define bc_mem_budget(ctx, soft, hard, fn, user) (BC_MEM_CALL(budget)(ctx, soft, hard, fn, user))
+}
+function usage          {Memory charged to the budget of a context.}        {{void* ctx}}                                       {size_t used} {
+/**
+* @brief bytes currently charged to the budget ctx belongs to, in O(1).
+*/
+#define bc_mem_usage(ctx) (BC_MEM_CALL(usage)(ctx))
+}
+function checkpoint     {Create a checkpoint of a chunk.}                   {{void* ptr} {const char* file} {int line}}         {} {
+/**
+* @brief creates a checkpoint of this memory chunk. 
+*
+* Every change that is performed
+* subsequent to the checkpoint is recognized
+*/
+#define bc_mem_checkpoint(ptr) (BC_MEM_CALL(checkpoint)(ptr, __FILE__, __LINE__))
+}
+function is_valid       {Check the validity of a chunk.}                    {{void* ptr}}                                       {bool valid} {
+/**
+* @brief check if the structure is valid.
+* there are several levels of validity:
+* - The header and sentinel magic areas are intact
+* - the checksum over internal data is equal to the save one from the previous checkpoint
+*
+* uninitialized memory from bc_mem_alloc is not checksummed before its first checkpoint.
+*/
+#define bc_mem_is_valid(ptr) (BC_MEM_CALL(is_valid)(ptr))
+}
+function report         {Report the current memory status.}                 {}                                                  {} {
+/**
+ * @brief reports the memory usage for each individual chunk
+ */
+#define bc_mem_report() (BC_MEM_CALL(report)())
+}
+function scrub_start    {Start integrity checking.}                         {{unsigned rate} {bc_mem_scrub_fn fn} {void* user}} {bool started} {
+/**
+ * @brief starts checking the integrity of all chunks.
+ *
+ * Corrupted magic and, for chunks with a checkpoint, modified content is
+ * reported through fn together with the allocation site. With a rate
+ * above 0 a background thread checks rate chunks per second, otherwise
+ * chunks are only checked by bc_mem_scrub_step. The checksums are
+ * computed without holding the lock of the memory manager, so other
+ * threads are only held up while the next few chunks are picked.
+ *
+ * The memory manager takes no lock until the scrubber is started for the
+ * first time, from then on every call is serialized. Start it before
+ * other threads use the memory manager.
+ */
+#define bc_mem_scrub_start(rate, fn, user) (BC_MEM_CALL(scrub_start)(rate, fn, user))
+}
+function scrub_stop     {Stop integrity checking.}                          {}                                                  {} {
+/**
+ * @brief stops the scrubber and its thread.
+ */
+#define bc_mem_scrub_stop() (BC_MEM_CALL(scrub_stop)())
+}
+function scrub_step     {Check the next chunks in the calling thread.}      {{unsigned count}}                                  {unsigned reported} {
+/**
+ * @brief checks the next count chunks in the calling thread.
+ *
+ * Violations are reported through the fn given to bc_mem_scrub_start,
+ * before this returns. A call ends at the end of the chunk list, the next
+ * one starts over at its beginning. Nothing is checked while the scrubber
+ * is stopped.
+ * @returns the number of violations reported
+ */
+#define bc_mem_scrub_step(count) (BC_MEM_CALL(scrub_step)(count))
+}
+
+footer {
+/**
+ * @brief strdup, with additional handling of the memory context
+ * 
+ */
+inline static char *bc_mem_strdup( void *ctx, const char *str ) {
+    size_t l = strlen( str );
+    char *result = bc_mem_array( ctx, char, l + 1 );
+    if( result == NULL )
+        return NULL;
+    memcpy( result, str, l + 1 );
+    bc_mem_checkpoint(result);
+    return result;
+}
+
+/**
+ * @brief initializes the memory manager and does the setup for the function calls.
+ */
+extern void bc_mem_init(void);
+
+/**
+* @\}
+*/
+}
@@ -11,8 +11,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
 #include "mem.h"
 #include "itab.h"
+#include "stats.h"
 
 
 /**
@@ -24,7 +27,17 @@
  @brief structure of an entry in the itab.
  */
 struct itab_entry {
-    const char *key;            ///< key
+    const char *key;            ///< key, allocated within the table
+    void *value;                ///< binary value
+};
+/**
+ @brief structure of an entry in a table created by itab_new_fixed.
+ */
+struct itab_fixed_entry {
+    union {
+        char key[ITAB_FIXED_KEY_MAX + 1];   ///< inline key, zero padded
+        uint64_t word[2];                   ///< inline key as two words
+    };
     void *value;                ///< binary value
 };
 /**
@@ -33,14 +46,44 @@ struct itab_entry {
 struct itab {
     unsigned total;             ///< total number of available entries
     unsigned used;              ///< actual used number of entries
-    struct itab_entry *rows;    ///< array of all entries
+    unsigned dead;              ///< entries of used that are deleted
+    unsigned stride;            ///< size of an entry, see itab_row
+    bool fixed;                 ///< keys are stored inline, see itab_new_fixed
+    void *rows;                 ///< array of all entries
 };
 
+/**
+ @brief an entry to search for, of either kind.
+ */
+union itab_probe {
+    struct itab_entry entry;
+    struct itab_fixed_entry fixed;
+};
+
+/**
+ @brief value marking a deleted row.
+
+ A deleted row keeps its key, so the rows stay sorted and can still be
+ searched, until the table is compacted.
+ */
+static char g_itab_tombstone;
+#define ITAB_TOMBSTONE ( ( void * )&g_itab_tombstone )
+
+/** itab_join_parallel joins smaller tables in the calling thread */
+#define ITAB_PARALLEL_MIN 4096
+
+/** keys allocated or released per call of the batch functions */
+#define ITAB_KEY_BATCH 64
+
+/** the table is compacted once more than 1/ITAB_COMPACT_RATIO of its
+    rows are deleted */
+#define ITAB_COMPACT_RATIO 4
+
 /** returns the number of lines in the table 
 */
 unsigned itab_lines( struct itab *itab ) {
     assert( itab != NULL );
-    return itab->used;
+    return itab->used - itab->dead;
 }
 
 /**
@@ -52,6 +95,52 @@ struct itab_iter {
     unsigned pos;               ///< current position in the table
 };
 
+/** stats ids of the instrumented operations, see bc_stats_end */
+static int g_itab_insert_stats = -1;
+static int g_itab_read_stats = -1;
+static int g_itab_foreach_stats = -1;
+static int g_itab_next_stats = -1;
+
+/** registered memory types of tables and iterators */
+static int g_itab_type = 0;
+static int g_itab_iter_type = 0;
+static pthread_once_t g_itab_types_once = PTHREAD_ONCE_INIT;
+
+/**
+ @brief registers the memory types used by itabs.
+
+ Runs once through pthread_once, tables may be created by several threads
+ at the same time.
+ */
+static void itab_register_types( void ) {
+    g_itab_type = bc_mem_register_type( struct itab );
+    g_itab_iter_type = bc_mem_register_type( struct itab_iter );
+}
+
+/**
+ @brief resizes the rows array, a new array if there is none yet.
+ */
+static void *itab_realloc_rows( struct itab *itab, unsigned total ) {
+    if( itab->fixed )
+        return bc_mem_realloc( itab, itab->rows, struct itab_fixed_entry,
+                               total );
+    return bc_mem_realloc( itab, itab->rows, struct itab_entry, total );
+}
+
+static struct itab *itab_create( bool fixed ) {
+    pthread_once( &g_itab_types_once, itab_register_types );
+    struct itab *r = bc_mem_alloc_typed( NULL, g_itab_type );
+    r->total = 10;
+    r->used = 0;
+    r->dead = 0;
+    r->fixed = fixed;
+    r->stride = fixed ? sizeof( struct itab_fixed_entry )
+            : sizeof( struct itab_entry );
+    r->rows = NULL;
+    r->rows = itab_realloc_rows( r, r->total );
+    return r;
+}
+
 /** 
  @brief create a new itab with default parameters.
  @return reference to an itab structure.
@@ -59,15 +148,26 @@ struct itab_iter {
  Detailed description follows here.
  */
 struct itab *itab_new(  ) {
-    struct itab *r = bc_mem_alloc( NULL, struct itab );
-    r->total = 10;
-    r->used = 0;
-    r->rows = bc_mem_array( r, struct itab_entry, r->total );
-    return r;
+    return itab_create( false );
+}
+
+/**
+ @brief create a new itab for short keys.
+
+ Keys of up to ITAB_FIXED_KEY_MAX characters are stored zero padded in
+ the rows themselves. No key is allocated separately, and two keys are
+ compared by at most two integer compares.
+ @return reference to an itab structure.
+ */
+struct itab *itab_new_fixed( void ) {
+    return itab_create( true );
 }
 
 /**
-@brief compares the keys of two entries
+@brief compares the keys of two entries of a table created by itab_new.
+
+Entries of fixed tables have a layout of their own and are never passed
+to this function.
 @return \arg < 0, when first key is lower
         \arg == 0, when both keys are equal
         \arg > 0, when second key is lower
@@ -79,26 +179,307 @@ int itab_entry_cmp( const void *aptr, const void *bptr ) {
 }
 
 /**
-* @brief insert a line into the table.
-* @callgraph
+ @brief a word of an inline key in big endian order.
+
+ Compared as numbers, these words order the keys like strcmp does.
+ */
+static uint64_t itab_be64( uint64_t w ) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64( w );
+#else
+    return w;
+#endif
+}
+
+/**
+@brief compares the inline keys of two entries, like itab_entry_cmp.
 */
-void itab_insert( struct itab *itab, const char *key, void *value ) {
-    assert( itab != NULL );
-    if( itab->total == itab->used ) {
-        itab->total *= 2;
-        itab->rows =
-                bc_mem_realloc( itab, itab->rows, struct itab_entry,
-                                itab->total );
+static int itab_fixed_cmp( const void *aptr, const void *bptr ) {
+    const struct itab_fixed_entry *a = aptr;
+    const struct itab_fixed_entry *b = bptr;
+    uint64_t x = itab_be64( a->word[0] );
+    uint64_t y = itab_be64( b->word[0] );
+    if( x == y ) {
+        x = itab_be64( a->word[1] );
+        y = itab_be64( b->word[1] );
+    }
+    return ( x > y ) - ( x < y );
+}
+
+static int ( *itab_cmp_fn( const struct itab *itab ) ) ( const void *,
+                                                         const void * ) {
+    return itab->fixed ? itab_fixed_cmp : itab_entry_cmp;
+}
+
+/**
+@brief entry i of a table, entries of both kinds are stride bytes apart.
+*/
+static void *itab_row( const struct itab *itab, unsigned i ) {
+    return ( char * )itab->rows + ( size_t )i * itab->stride;
+}
+
+static const char *itab_row_key( const struct itab *itab, const void *row ) {
+    if( itab->fixed )
+        return ( ( const struct itab_fixed_entry * )row )->key;
+    return ( ( const struct itab_entry * )row )->key;
+}
+
+static void *itab_row_value( const struct itab *itab, const void *row ) {
+    if( itab->fixed )
+        return ( ( const struct itab_fixed_entry * )row )->value;
+    return ( ( const struct itab_entry * )row )->value;
+}
+
+static void itab_set_value( const struct itab *itab, void *row,
+                            void *value ) {
+    if( itab->fixed )
+        ( ( struct itab_fixed_entry * )row )->value = value;
+    else
+        ( ( struct itab_entry * )row )->value = value;
+}
+
+static bool itab_alive( const struct itab *itab, const void *row ) {
+    return itab_row_value( itab, row ) != ITAB_TOMBSTONE;
+}
+
+/**
+@brief compares two rows of the same or of different tables.
+*/
+static int itab_row_cmp( const struct itab *ta, const void *a,
+                         const struct itab *tb, const void *b ) {
+    if( ta->fixed && tb->fixed )
+        return itab_fixed_cmp( a, b );
+    return strcmp( itab_row_key( ta, a ), itab_row_key( tb, b ) );
+}
+
+/**
+* @brief stores a key zero padded in an entry of a fixed table.
+* @returns false if the key is too long.
+*/
+static bool itab_fixed_key( struct itab_fixed_entry *row, const char *key ) {
+    size_t len = strlen( key );
+    if( len > ITAB_FIXED_KEY_MAX )
+        return false;
+    memset( row->key, 0, sizeof( row->key ) );
+    memcpy( row->key, key, len );
+    return true;
+}
+
+/**
+* @brief prepares an entry to search for a key, the key is not copied.
+* @returns false if the key is too long for a fixed table.
+*/
+static bool itab_probe( const struct itab *itab, union itab_probe *probe,
+                        const char *key ) {
+    if( itab->fixed )
+        return itab_fixed_key( &probe->fixed, key );
+    probe->entry.key = key;
+    return true;
+}
+
+/**
+* @brief stores a copy of the key in a row.
+* @returns false if the key does not fit or cannot be allocated.
+*/
+static bool itab_store_key( struct itab *itab, void *row, const char *key ) {
+    if( itab->fixed )
+        return itab_fixed_key( row, key );
+    struct itab_entry *e = row;
+    e->key = bc_mem_strdup( itab, key );
+    return e->key != NULL;
+}
+
+/**
+* @brief makes room for at least n more rows.
+* @returns false if the memory could not be allocated.
+*/
+static bool itab_reserve( struct itab *itab, unsigned n ) {
+    if( itab->used + n <= itab->total )
+        return true;
+    unsigned total = itab->total;
+    while( itab->used + n > total )
+        total *= 2;
+    void *rows = itab_realloc_rows( itab, total );
+    if( rows == NULL )
+        return false;
+    itab->rows = rows;
+    itab->total = total;
+    return true;
+}
+
+/**
+* @brief finds the row of a key.
+*
+* Among rows with equal keys a live row is preferred over a deleted one.
+* @returns the row or NULL if the key has never been inserted.
+*/
+static void *itab_find( struct itab *itab, const char *key ) {
+    union itab_probe dummy;
+    if( !itab_probe( itab, &dummy, key ) )
+        return NULL;
+    int ( *cmp ) ( const void *, const void * ) = itab_cmp_fn( itab );
+    char *r = bsearch( &dummy, itab->rows, itab->used, itab->stride, cmp );
+    if( r == NULL || itab_alive( itab, r ) || itab->dead == 0 )
+        return r;
+    unsigned first = ( unsigned )( ( r - ( char * )itab->rows )
+                                   / itab->stride );
+    while( first > 0 && cmp( itab_row( itab, first - 1 ), &dummy ) == 0 )
+        first--;
+    for( unsigned i = first;
+         i < itab->used && cmp( itab_row( itab, i ), &dummy ) == 0; i++ )
+        if( itab_alive( itab, itab_row( itab, i ) ) )
+            return itab_row( itab, i );
+    return itab_row( itab, first );
+}
+
+/**
+* @brief releases the keys of the rows from..to-1 in batches.
+* @param dead_only  release only the keys of deleted rows
+*/
+static void itab_unlink_keys( struct itab *itab, unsigned from, unsigned to,
+                              bool dead_only ) {
+    if( itab->fixed )
+        return;
+    struct itab_entry *rows = itab->rows;
+    void *keys[ITAB_KEY_BATCH];
+    int n = 0;
+    for( unsigned i = from; i < to; i++ ) {
+        struct itab_entry *row = &rows[i];
+        if( dead_only && row->value != ITAB_TOMBSTONE )
+            continue;
+        keys[n++] = ( void * )row->key;
+        if( n == ITAB_KEY_BATCH ) {
+            bc_mem_unlink_batch( keys, n );
+            n = 0;
+        }
+    }
+    if( n > 0 )
+        bc_mem_unlink_batch( keys, n );
+}
+
+/**
+* @brief removes all deleted rows and releases their keys.
+*
+* The remaining rows keep their order, so no sort is needed.
+*/
+static void itab_compact( struct itab *itab ) {
+    itab_unlink_keys( itab, 0, itab->used, true );
+    unsigned to = 0;
+    for( unsigned from = 0; from < itab->used; from++ ) {
+        void *row = itab_row( itab, from );
+        if( !itab_alive( itab, row ) )
+            continue;
+        if( to != from )
+            memcpy( itab_row( itab, to ), row, itab->stride );
+        to++;
+    }
+    itab->used = to;
+    itab->dead = 0;
+}
+
+static bool itab_insert_row( struct itab *itab, const char *key,
+                             void *value ) {
+    if( itab->dead > 0 ) {
+        void *row = itab_find( itab, key );
+        if( row && !itab_alive( itab, row ) ) {
+            // revive the deleted row, its key is already in place
+            itab_set_value( itab, row, value );
+            itab->dead--;
+            return true;
+        }
     }
-    struct itab_entry *row = &itab->rows[itab->used];
-    row->key = bc_mem_strdup( itab, key );
-    row->value = value;
+    if( !itab_reserve( itab, 1 ) )
+        return false;
+    void *row = itab_row( itab, itab->used );
+    if( !itab_store_key( itab, row, key ) )
+        return false;
+    itab_set_value( itab, row, value );
     itab->used++;
 
     qsort( itab->rows,                           // base
            itab->used,                           // nmemb
-           sizeof( struct itab_entry ),          // size
+           itab->stride,                         // size
+           itab_cmp_fn( itab ) );
+    return true;
+}
+
+/**
+* @brief insert a line into the table.
+* @returns false if the memory budget of the table is exhausted or the
+*          key is too long for a fixed table, the table is unchanged then.
+* @callgraph
+*/
+bool itab_insert( struct itab *itab, const char *key, void *value ) {
+    assert( itab != NULL );
+    uint64_t t0 = bc_stats_begin(  );
+    bool r = itab_insert_row( itab, key, value );
+    bc_stats_end( &g_itab_insert_stats, "itab_insert", t0 );
+    return r;
+}
+
+/**
+* @brief insert n lines into the table at once.
+*
+* The rows array is grown only once. Keys of equal length that follow each
+* other are copied into chunks of one batch allocation, each chunk sized
+* by its own key. A fixed table needs no key allocation at all.
+* The table is sorted once at the end instead of after every row.
+* @param keys   n keys, copied into the table
+* @param values n values
+* @returns false if the memory budget of the table is exhausted or a key
+*          is too long for a fixed table, no row is inserted then.
+*/
+bool itab_insert_batch( struct itab *itab, unsigned n, const char **keys,
+                        void **values ) {
+    assert( itab != NULL );
+    if( n == 0 )
+        return true;
+    if( !itab_reserve( itab, n ) )
+        return false;
+
+    if( itab->fixed ) {
+        for( unsigned i = 0; i < n; i++ )
+            if( strlen( keys[i] ) > ITAB_FIXED_KEY_MAX )
+                return false;
+        struct itab_fixed_entry *row = itab_row( itab, itab->used );
+        for( unsigned i = 0; i < n; i++, row++ ) {
+            itab_fixed_key( row, keys[i] );
+            row->value = values[i];
+        }
+        itab->used += n;
+        qsort( itab->rows, itab->used, sizeof( struct itab_fixed_entry ),
+               itab_fixed_cmp );
+        return true;
+    }
+
+    struct itab_entry *rows = itab_row( itab, itab->used );
+    unsigned i = 0;
+    while( i < n ) {
+        // a run of at most ITAB_KEY_BATCH keys of the same length
+        size_t len = strlen( keys[i] );
+        unsigned run = 1;
+        while( run < ITAB_KEY_BATCH && i + run < n
+               && strlen( keys[i + run] ) == len )
+            run++;
+        char *copies[ITAB_KEY_BATCH];
+        unsigned got = bc_mem_array_batch( itab, char, len + 1, run, copies );
+        if( got < run ) {
+            bc_mem_unlink_batch( copies, got );
+            itab_unlink_keys( itab, itab->used, itab->used + i, false );
+            return false;
+        }
+        for( unsigned k = 0; k < run; k++, i++ ) {
+            memcpy( copies[k], keys[i], len + 1 );
+            bc_mem_checkpoint( copies[k] );
+            rows[i].key = copies[k];
+            rows[i].value = values[i];
+        }
+    }
+    itab->used += n;
+
+    qsort( itab->rows, itab->used, sizeof( struct itab_entry ),
            itab_entry_cmp );
+    return true;
 }
 
 /**
@@ -113,16 +494,315 @@ void itab_insert( struct itab *itab, const char *key, void *value ) {
 void *itab_read( struct itab *itab, const char *key ) {
     assert( itab );
     assert( key );
-    struct itab_entry dummy = { key, NULL };
-    struct itab_entry *r = bsearch( &dummy,
-                                    itab->rows,
-                                    itab->used,
-                                    sizeof( struct itab_entry ),
-                                    itab_entry_cmp );
-    if( r )
-        return r->value;
-    else
-        return NULL;
+    uint64_t t0 = bc_stats_begin(  );
+    void *r = itab_find( itab, key );
+    void *value = r && itab_alive( itab, r ) ? itab_row_value( itab, r ) : NULL;
+    bc_stats_end( &g_itab_read_stats, "itab_read", t0 );
+    return value;
+}
+
+/**
+* @brief deletes the row of the given key.
+*
+* The row is only marked as deleted, so the rows array is not shifted.
+* Once too many rows are deleted the table is compacted and the keys of
+* the deleted rows are released. Rows must not be deleted while the
+* table is iterated.
+* @returns false if there is no row with that key.
+*/
+bool itab_delete( struct itab *itab, const char *key ) {
+    assert( itab );
+    assert( key );
+    void *r = itab_find( itab, key );
+    if( r == NULL || !itab_alive( itab, r ) )
+        return false;
+    itab_set_value( itab, r, ITAB_TOMBSTONE );
+    itab->dead++;
+    if( itab->dead * ITAB_COMPACT_RATIO > itab->used )
+        itab_compact( itab );
+    return true;
+}
+
+/**
+* @brief replaces the value of an existing row.
+* @returns false if there is no row with that key.
+*/
+bool itab_update( struct itab *itab, const char *key, void *value ) {
+    assert( itab );
+    assert( key );
+    void *r = itab_find( itab, key );
+    if( r == NULL || !itab_alive( itab, r ) )
+        return false;
+    itab_set_value( itab, r, value );
+    return true;
+}
+
+/**
+* @brief replaces the value of a row or inserts the row if it is missing.
+* @returns false if the memory budget of the table is exhausted.
+*/
+bool itab_upsert( struct itab *itab, const char *key, void *value ) {
+    if( itab_update( itab, key, value ) )
+        return true;
+    return itab_insert( itab, key, value );
+}
+
+/**
+* @brief position of the first row whose key is not lower than key.
+*/
+static unsigned itab_lower_bound( struct itab *itab, const char *key ) {
+    union itab_probe probe;
+    bool fast = itab->fixed && itab_probe( itab, &probe, key );
+    unsigned lo = 0;
+    unsigned hi = itab->used;
+    while( lo < hi ) {
+        unsigned mid = lo + ( hi - lo ) / 2;
+        const void *row = itab_row( itab, mid );
+        int c = fast ? itab_fixed_cmp( row, &probe )
+                : strcmp( itab_row_key( itab, row ), key );
+        if( c < 0 )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+* @brief merges two sorted row ranges and reports all pairs of equal keys.
+*
+* The ranges are the rows a..a_end-1 of ta and b..b_end-1 of tb. Rows with
+* equal keys on both sides are reported as cross product.
+*/
+static void itab_merge_join( const struct itab *ta, unsigned a, unsigned a_end,
+                             const struct itab *tb, unsigned b, unsigned b_end,
+                             itab_join_fn fn, void *user ) {
+    while( a < a_end && b < b_end ) {
+        const void *y = itab_row( tb, b );
+        int c = itab_row_cmp( ta, itab_row( ta, a ), tb, y );
+        if( c < 0 )
+            a++;
+        else if( c > 0 )
+            b++;
+        else {
+            unsigned run = b;
+            while( run < b_end
+                   && itab_row_cmp( tb, itab_row( tb, run ), tb, y ) == 0 )
+                run++;
+            for( ; a < a_end
+                 && itab_row_cmp( ta, itab_row( ta, a ), tb, y ) == 0; a++ ) {
+                const void *x = itab_row( ta, a );
+                if( !itab_alive( ta, x ) )
+                    continue;
+                for( unsigned e = b; e < run; e++ ) {
+                    const void *z = itab_row( tb, e );
+                    if( itab_alive( tb, z ) )
+                        fn( itab_row_key( ta, x ), itab_row_value( ta, x ),
+                            itab_row_value( tb, z ), user );
+                }
+            }
+            b = run;
+        }
+    }
+}
+
+/**
+* @brief calls fn for every pair of rows with equal keys.
+*
+* Both tables are walked once in key order, so the join costs O(n+m)
+* instead of one binary search per row.
+*/
+void itab_join( struct itab *a, struct itab *b, itab_join_fn fn, void *user ) {
+    assert( a && b && fn );
+    itab_merge_join( a, 0, a->used, b, 0, b->used, fn, user );
+}
+
+/**
+ @brief key range of a parallel join.
+ */
+struct itab_join_part {
+    const struct itab *ta;          ///< left table
+    const struct itab *tb;          ///< right table
+    unsigned a;                     ///< first row of the left table
+    unsigned a_end;
+    unsigned b;                     ///< first row of the right table
+    unsigned b_end;
+    itab_join_fn fn;
+    void *user;
+    pthread_t thread;
+    bool started;                   ///< runs in its own thread
+};
+
+static void *itab_join_thread( void *arg ) {
+    struct itab_join_part *p = arg;
+    itab_merge_join( p->ta, p->a, p->a_end, p->tb, p->b, p->b_end,
+                     p->fn, p->user );
+    return NULL;
+}
+
+/**
+* @brief joins like itab_join, split into key ranges merged in parallel.
+*
+* The left table is cut into ranges of about equal size, equal keys never
+* end up in different ranges. The matching part of the right table is
+* found by binary search. fn is called from several threads at once and
+* must be thread safe. Neither table may be modified during the join.
+* Small tables are joined in the calling thread.
+* @param threads number of ranges, at most 64
+*/
+void itab_join_parallel( struct itab *a, struct itab *b, unsigned threads,
+                         itab_join_fn fn, void *user ) {
+    assert( a && b && fn );
+    if( threads > 64 )
+        threads = 64;
+    if( threads < 2 || a->used < ITAB_PARALLEL_MIN ) {
+        itab_join( a, b, fn, user );
+        return;
+    }
+    struct itab_join_part parts[64];
+    unsigned a_pos = 0;
+    unsigned b_pos = 0;
+    for( unsigned t = 0; t < threads; t++ ) {
+        unsigned a_end = ( unsigned )( ( unsigned long long )a->used
+                                       * ( t + 1 ) / threads );
+        if( a_end < a_pos )
+            a_end = a_pos;
+        while( a_end > 0 && a_end < a->used
+               && itab_row_cmp( a, itab_row( a, a_end - 1 ),
+                                a, itab_row( a, a_end ) ) == 0 )
+            a_end++;
+        unsigned b_end = a_end < a->used ?
+                itab_lower_bound( b, itab_row_key( a, itab_row( a, a_end ) ) )
+                : b->used;
+        struct itab_join_part *p = &parts[t];
+        p->ta = a;
+        p->tb = b;
+        p->a = a_pos;
+        p->a_end = a_end;
+        p->b = b_pos;
+        p->b_end = b_end;
+        p->fn = fn;
+        p->user = user;
+        p->started = t > 0
+                && pthread_create( &p->thread, NULL, itab_join_thread, p ) == 0;
+        a_pos = a_end;
+        b_pos = b_end;
+    }
+    // the first range, and any range without a thread, runs here
+    for( unsigned t = 0; t < threads; t++ )
+        if( !parts[t].started )
+            itab_join_thread( &parts[t] );
+    for( unsigned t = 1; t < threads; t++ )
+        if( parts[t].started )
+            pthread_join( parts[t].thread, NULL );
+}
+
+/**
+* @brief appends a row that sorts behind all rows of the table.
+*/
+static bool itab_append( struct itab *itab, const char *key, void *value ) {
+    if( !itab_reserve( itab, 1 ) )
+        return false;
+    void *row = itab_row( itab, itab->used );
+    if( !itab_store_key( itab, row, key ) )
+        return false;
+    itab_set_value( itab, row, value );
+    itab->used++;
+    return true;
+}
+
+enum itab_set_op {
+    ITAB_INTERSECT,
+    ITAB_DIFFERENCE,
+    ITAB_UNION,
+};
+
+/**
+* @brief builds a new table out of a linear merge of two tables.
+*
+* The rows come out in key order, so the result needs no sort.
+* Rows taken from a keep their value, rows of b only appear in a union.
+* The result is a fixed table if all its rows come from fixed tables.
+* @returns the new table or NULL if the memory is exhausted.
+*/
+static struct itab *itab_set_op( struct itab *a, struct itab *b,
+                                 enum itab_set_op op ) {
+    assert( a && b );
+    struct itab *r = itab_create( a->fixed && ( op != ITAB_UNION
+                                                || b->fixed ) );
+    unsigned x = 0;
+    unsigned y = 0;
+    bool ok = true;
+
+    while( ok && ( x < a->used || y < b->used ) ) {
+        const void *xr = x < a->used ? itab_row( a, x ) : NULL;
+        const void *yr = y < b->used ? itab_row( b, y ) : NULL;
+        if( xr && !itab_alive( a, xr ) ) {
+            x++;
+            continue;
+        }
+        if( yr && !itab_alive( b, yr ) ) {
+            y++;
+            continue;
+        }
+        int c = xr == NULL ? 1 : yr == NULL ? -1
+                : itab_row_cmp( a, xr, b, yr );
+        if( c < 0 ) {
+            if( op != ITAB_INTERSECT )
+                ok = itab_append( r, itab_row_key( a, xr ),
+                                  itab_row_value( a, xr ) );
+            x++;
+        }
+        else if( c > 0 ) {
+            if( op == ITAB_UNION )
+                ok = itab_append( r, itab_row_key( b, yr ),
+                                  itab_row_value( b, yr ) );
+            else if( xr == NULL )
+                break;
+            y++;
+        }
+        else {
+            // all rows of a with this key, none of b
+            const void *first = xr;
+            for( ; ok && x < a->used
+                 && itab_row_cmp( a, itab_row( a, x ), a, first ) == 0; x++ ) {
+                const void *row = itab_row( a, x );
+                if( op != ITAB_DIFFERENCE && itab_alive( a, row ) )
+                    ok = itab_append( r, itab_row_key( a, row ),
+                                      itab_row_value( a, row ) );
+            }
+            while( y < b->used
+                   && itab_row_cmp( b, itab_row( b, y ), a, first ) == 0 )
+                y++;
+        }
+    }
+    if( !ok )
+        r = itab_free( r );
+    return r;
+}
+
+/**
+* @brief rows of a whose key is also in b.
+* @returns a new table or NULL if the memory is exhausted.
+*/
+struct itab *itab_intersect( struct itab *a, struct itab *b ) {
+    return itab_set_op( a, b, ITAB_INTERSECT );
+}
+
+/**
+* @brief rows of a whose key is not in b.
+* @returns a new table or NULL if the memory is exhausted.
+*/
+struct itab *itab_difference( struct itab *a, struct itab *b ) {
+    return itab_set_op( a, b, ITAB_DIFFERENCE );
+}
+
+/**
+* @brief rows of a and rows of b whose key is not in a.
+* @returns a new table or NULL if the memory is exhausted.
+*/
+struct itab *itab_union( struct itab *a, struct itab *b ) {
+    return itab_set_op( a, b, ITAB_UNION );
 }
 
 /**
@@ -132,8 +812,12 @@ void *itab_read( struct itab *itab, const char *key ) {
 */
 void itab_dump( struct itab *itab ) {
     assert( itab );
-    for( int i = 0; i < itab->used; i++ ) {
-        fprintf( stderr, "%s: %p\n", itab->rows[i].key, itab->rows[i].value );
+    for( unsigned i = 0; i < itab->used; i++ ) {
+        const void *row = itab_row( itab, i );
+        if( !itab_alive( itab, row ) )
+            continue;
+        fprintf( stderr, "%s: %p\n", itab_row_key( itab, row ),
+                 itab_row_value( itab, row ) );
     }
 }
 
@@ -144,45 +828,58 @@ void itab_dump( struct itab *itab ) {
 * this iterator then is used to go to the next row in the table.
 */
 struct itab_iter *itab_foreach( struct itab *tab ) {
-    if( tab->used > 0 ) {
-        struct itab_iter *r = bc_mem_alloc( NULL, struct itab_iter );
+    uint64_t t0 = bc_stats_begin(  );
+    struct itab_iter *r = NULL;
+    unsigned pos = 0;
+    while( pos < tab->used && !itab_alive( tab, itab_row( tab, pos ) ) )
+        pos++;
+    if( pos < tab->used ) {
+        r = bc_mem_alloc_typed( NULL, g_itab_iter_type );
         r->tab = tab;
-        r->pos = 0;
-        return r;
+        r->pos = pos;
     }
-    else
-        return NULL;
+    bc_stats_end( &g_itab_foreach_stats, "itab_foreach", t0 );
+    return r;
 }
 
 /**
 * @brief jump to the next element in that iterator.
 */
 struct itab_iter *itab_next( struct itab_iter *iter ) {
+    uint64_t t0 = bc_stats_begin(  );
     iter->pos++;
-    if( iter->tab->used > iter->pos ) {
-        return iter;
-    }
-    else {
+    while( iter->pos < iter->tab->used
+           && !itab_alive( iter->tab, itab_row( iter->tab, iter->pos ) ) )
+        iter->pos++;
+    if( iter->tab->used <= iter->pos ) {
         bc_mem_unlink( iter );
-        return NULL;
+        iter = NULL;
     }
+    bc_stats_end( &g_itab_next_stats, "itab_next", t0 );
+    return iter;
 }
 
 /**
 * @brief returning the value of the current row within the iterator.
 */
 void *itab_value( struct itab_iter *iter ) {
-    return iter->tab->rows[iter->pos].value;
+    return itab_row_value( iter->tab, itab_row( iter->tab, iter->pos ) );
 }
 
 /**
 * @brief returning the key of the current row under investigation.
+*
+* A table created by itab_new keeps the key until its row is deleted. A
+* fixed table stores the key in the row itself, so the pointer is only
+* valid until the next insert or delete on the table moves the rows.
 */
 const char *itab_key( struct itab_iter *iter ) {
-    return iter->tab->rows[iter->pos].key;
+    return itab_row_key( iter->tab, itab_row( iter->tab, iter->pos ) );
 }
 
 t_itab itab_free(t_itab itab){
+    if( itab )
+        itab_unlink_keys( itab, 0, itab->used, false );
     return (t_itab)bc_mem_unlink(itab);
     
 }
@@ -10,12 +10,18 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 #include "internal.h"
 #include "mem.h"
 #include <malloc.h>
 #include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 extern struct mem g_mem;
 #define MAGIC_START 0x12345678
@@ -30,25 +36,74 @@ typedef struct {
     unsigned int sum;
 } t_magic;
 
+/**
+ * @brief memory quota of a context.
+ *
+ * Every chunk allocated in the context or one of its descendants is
+ * charged with its page size. Budgets nest, a chunk is charged to its own
+ * budget and to all enclosing ones.
+ */
+typedef struct mem_budget {
+    size_t used;                    ///< bytes currently charged
+    size_t soft;                    ///< callback is raised above this, 0 for none
+    size_t hard;                    ///< allocations fail above this, 0 for none
+    bc_mem_budget_fn fn;            ///< soft limit callback
+    void *user;                     ///< passed to the callback
+    bool signalled;                 ///< callback raised, not yet below soft limit
+    struct mem_hd *owner;           ///< context the budget is attached to
+    struct mem_budget *parent;      ///< enclosing budget
+    struct mem_budget *next;        ///< list of all budgets
+} t_mem_budget;
+
+/** bits of the type id in the header, see mem_register_type */
+#define MEM_TYPE_BITS 11
+
+/**
+ * @brief header in front of every payload.
+ *
+ * Every chunk pays for it, so fields that are never used at the same time
+ * share their storage and flags are packed. Small payloads have to fit
+ * into the smallest page size of 128 bytes together with the sentinel.
+ */
 typedef struct mem_hd {
     t_magic magic;
     size_t size;    ///< total allocated size */
-    size_t len;     ///< requested size */
     t_location allocated;
-    t_location last_checked;
-    t_location freed;
+    union {
+        t_location last_checked;    ///< while the chunk is in use
+        t_location freed;           ///< once the chunk is free
+    };
     struct mem_hd *next;
-    struct mem_hd * next_free;
-    struct mem_lst * children;    
-    bool free;
+    struct mem_hd * parent;         ///< context the chunk belongs to
+    struct mem_hd * children;       ///< first chunk allocated in this context
+    struct mem_hd * next_sibling;   ///< next chunk of the same context
+    union {
+        struct mem_hd * prev_sibling;   ///< previous chunk of the same context
+        struct mem_hd * next_free;      ///< free list the chunk is in
+    };
+    unsigned len;   ///< requested size, size * count of two ints */
+    unsigned type : MEM_TYPE_BITS;  ///< registered type, 0 for untyped chunks
+    unsigned free : 1;
+    unsigned sealed : 1;    ///< the checksum covers the payload
+    unsigned reported : 1;  ///< the scrubber reported a violation since the last checkpoint
+    unsigned guarded : 1;   ///< payload lives on its own pages, see mem_guarded
+    unsigned budgeted : 1;  ///< a budget is attached to this context
+    unsigned gen : 16;      ///< bumped on allocation, release and checkpoint
 
     char *data[0];
 } t_mem_hd;
 
-typedef struct mem_lst {
-    t_mem_hd * chunk;
-    struct mem_lst * next;
-} t_mem_lst;
+/**
+ * @brief bookkeeping only needed by guarded chunks.
+ *
+ * It sits right before the header in the first page of the mapping, so
+ * the header of ordinary chunks does not grow.
+ */
+typedef struct mem_guard {
+    void *dirty_addr;               ///< address of the first write, NULL if clean
+    struct mem_hd *next;            ///< list of all guarded chunks
+    bool protect;                   ///< payload pages are write protected
+} t_mem_guard;
 
 
 
@@ -56,6 +111,9 @@ typedef struct mem_sentinel {
     t_magic magic;
 } t_mem_sentinel;
 
+_Static_assert( sizeof( t_mem_hd ) + sizeof( t_mem_sentinel ) + 16 <= 128,
+                "a 16 byte payload has to fit into the smallest page" );
+
 
 /** 
  * @brief all chunks that have been allocated.
@@ -74,6 +132,70 @@ static t_mem_hd *g_chunks = NULL;
 
 static t_mem_hd *g_free_list = NULL;
 
+/**
+ * @brief list of all budgets.
+ *
+ * Chunks do not point to their budget. It belongs to the closest context
+ * up the tree that has the budgeted flag and is looked up here.
+ */
+static t_mem_budget *g_budgets = NULL;
+
+/**
+ * @brief list of all guarded chunks, searched by the fault handler.
+ *
+ * The handler runs without the lock, possibly while another thread adds
+ * a chunk. Chunks are only ever pushed in front and never removed, so the
+ * head is published with release semantics and read with acquire.
+ */
+static t_mem_hd *g_guarded = NULL;
+
+/**
+ * @brief SIGSEGV handler that was installed before ours.
+ */
+static struct sigaction g_old_segv;
+static bool g_segv_installed = false;
+
+/**
+ * @brief page size of the OS, read before the first guarded chunk exists.
+ *
+ * sysconf is not async-signal-safe, the fault handler uses this copy.
+ */
+static size_t g_os_page = 0;
+
+static size_t mem_os_page( void ) {
+    if( g_os_page == 0 )
+        g_os_page = sysconf( _SC_PAGESIZE );
+    return g_os_page;
+}
+
+/**
+ * @brief number of chunks carved out of one slab of a type pool.
+ */
+#define MEM_SLAB_CHUNKS 64
+
+/**
+ * @brief a registered type and its pool.
+ *
+ * Chunks of a registered type are carved out of slabs that hold only this
+ * type, so objects of one type are contiguous. Released chunks go back to
+ * the pool of their type and not to the general free list.
+ */
+typedef struct mem_type {
+    const char *name;
+    size_t size;            ///< size of one object
+    size_t page_size;       ///< size of a chunk including header and sentinel
+    t_mem_hd *free_list;    ///< released chunks of this type
+    size_t live;            ///< chunks in use
+    size_t pooled;          ///< chunks in the free list
+    size_t slabs;           ///< slabs allocated
+} t_mem_type;
+
+/**
+ * @brief registry of all types, index 0 is the untyped memory.
+ */
+static t_mem_type *g_types = NULL;
+static int g_type_count = 1;
+
 /**
  * @brief lower limit of memory.
  * 
@@ -89,8 +211,77 @@ static char *mem_limit_high = NULL;
 
 
 
+/**
+ * @brief serializes access to the bookkeeping.
+ *
+ * Every mem_std entry point holds it once locking is on. It is recursive,
+ * so callbacks raised under it may call back into the memory manager.
+ */
+static pthread_mutex_t g_mem_lock;
+static pthread_once_t g_mem_lock_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief locking is on, see mem_locking_on.
+ *
+ * Set by the first start of the scrubber and never cleared, so a thread
+ * that took the lock always releases it again.
+ */
+static bool g_mem_locking = false;
+
+/**
+ * @brief state of the background scrubber.
+ */
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;           ///< protects running, used with wake
+    pthread_cond_t wake;            ///< signalled to stop the thread
+    bool active;                    ///< started, fn is set
+    bool running;                   ///< the thread runs
+    unsigned rate;                  ///< chunks checked per second
+    bc_mem_scrub_fn fn;
+    void *user;
+    t_mem_hd *cursor;               ///< next chunk to check, under g_mem_lock
+} g_scrub = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+};
+
+
+
 static void mem_checkpoint( void *ptr, const char *file, int line );
 static void* mem_unlink( void *ptr , const char *file, int line );
+static void mem_unprotect( t_mem_hd * hd );
+
+static void mem_lock_init( void ) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init( &attr );
+    pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+    pthread_mutex_init( &g_mem_lock, &attr );
+    pthread_mutexattr_destroy( &attr );
+}
+
+/**
+ * @brief turns on locking for all following calls.
+ *
+ * Single threaded programs that never start the scrubber do not pay for
+ * the lock. Calls running in other threads at the same time are not
+ * covered, so this has to happen before other threads use the memory
+ * manager.
+ */
+static void mem_locking_on( void ) {
+    pthread_once( &g_mem_lock_once, mem_lock_init );
+    __atomic_store_n( &g_mem_locking, true, __ATOMIC_RELEASE );
+}
+
+static void mem_lock( void ) {
+    if( __atomic_load_n( &g_mem_locking, __ATOMIC_ACQUIRE ) )
+        pthread_mutex_lock( &g_mem_lock );
+}
+
+static void mem_unlock( void ) {
+    if( __atomic_load_n( &g_mem_locking, __ATOMIC_RELAXED ) )
+        pthread_mutex_unlock( &g_mem_lock );
+}
 
 
 
@@ -104,6 +295,10 @@ static t_mem_hd *header_ptr( void *payload ) {
     return ( void * )m;
 }
 
+static t_mem_guard *guard_ptr( t_mem_hd * hd ) {
+    return ( t_mem_guard * ) hd - 1;
+}
+
 static t_mem_sentinel *sentinel_ptr( t_mem_hd * hd ) {
     char *m = ( char * )hd;
     m += sizeof( *hd );
@@ -111,12 +306,18 @@ static t_mem_sentinel *sentinel_ptr( t_mem_hd * hd ) {
     return ( t_mem_sentinel * ) m;
 }
 
-static t_magic calculate_magic( t_mem_hd * hd ) {
+/**
+ * @brief checksum of the first len bytes of a payload.
+ *
+ * len is passed in, so the scrubber can use the length it saw under the
+ * lock while it sums without the lock.
+ */
+static t_magic calculate_magic( t_mem_hd * hd, size_t len ) {
     t_magic magic;
     magic.c = MAGIC_START;
-    magic.sum = hd->len;
+    magic.sum = len;
     unsigned char *m = ( unsigned char * )payload_ptr( hd );
-    for( size_t i = 0; i < hd->len; i++ ) {
+    for( size_t i = 0; i < len; i++ ) {
         magic.sum += m[i];
     }
     return magic;
@@ -141,9 +342,19 @@ static void check_ptr( void *ptr, bool *range, bool *magic, bool *sum ) {
                 && ( hd->magic.sum == sentinel->magic.sum );
     }
     if( *magic && sum != NULL ) {
-        t_magic magic = calculate_magic( hd );
-        if( magic.sum == hd->magic.sum )
+        if( hd->guarded ) {
+            // writes are tracked by the page protection
+            *sum = guard_ptr( hd )->dirty_addr == NULL;
+        }
+        else if( !hd->sealed ) {
+            // uninitialized payload, nothing to compare against yet
             *sum = true;
+        }
+        else {
+            t_magic magic = calculate_magic( hd, hd->len );
+            if( magic.sum == hd->magic.sum )
+                *sum = true;
+        }
     }
 
 // if(!*range) fprintf(stderr, "range check failed %p\n", ptr);
@@ -195,67 +406,557 @@ static void mem_adjust_limits(char* m, size_t total_size){
  * Search is done sequentially through all available pages.
  * 
  * @param page_size     size of the page
+ * @param guarded       look for a guarded chunk
  * @return t_mem_hd*    pointer to the header, or NULL if nothing found.
  */
-static t_mem_hd * mem_find_free_chunk(size_t page_size){
+static t_mem_hd * mem_find_free_chunk(size_t page_size, bool guarded){
     t_mem_hd *prev_hd = NULL; 
     t_mem_hd *result = NULL;
     for(t_mem_hd *hd = g_free_list; hd; hd = hd->next_free){
-        if(hd->size == page_size){
+        if(hd->size == page_size && hd->guarded == guarded){
             result = hd;
             if(prev_hd) prev_hd->next_free = hd->next_free;
             else g_free_list = hd->next_free;
             break;
         }
+        prev_hd = hd;
     }
     return result;
 }
 
 
-static void *mem_realloc( void *context, void *ptr, int size, int count,
-                          const char *file, int line ) {
-    size_t payload_size = size * count;
+/**
+ * @brief rounds the size of a chunk up to the next page size.
+ */
+static size_t mem_page_size( size_t payload_size ) {
     size_t total_size =
             sizeof( t_mem_hd ) + sizeof( t_mem_sentinel ) + payload_size;
     size_t page_size = 128;
     while(total_size > page_size) page_size <<= 1;
-    
-    t_mem_hd *hd = mem_find_free_chunk(page_size);
-    if(hd == NULL){ 
-        hd = malloc( page_size );
-        memset( hd, 0, page_size );
-        hd->next = g_chunks;
-        g_chunks = hd;    
-        mem_adjust_limits((char*)hd, total_size);
-        hd->size = page_size;
-    }
+    return page_size;
+}
 
+/**
+ * @brief prepares the header of a chunk that is handed out.
+ *
+ * All bookkeeping of a previous use of the chunk is cleared.
+ * Only the requested length of the payload is zeroed, and only if asked
+ * for. The checksum of a zeroed payload is known without scanning it.
+ * An uninitialized payload is not covered by a checksum until its first
+ * checkpoint.
+ */
+static void mem_init_chunk( t_mem_hd * hd, size_t payload_size, bool zero,
+                            const char *file, int line ) {
     hd->len = payload_size;
-    hd->magic = calculate_magic( hd );
+    if( zero )
+        memset( payload_ptr( hd ), 0, payload_size );
+    hd->sealed = zero;
+    hd->type = 0;
+    hd->reported = false;
+    hd->budgeted = false;
+    if( hd->guarded ) {
+        guard_ptr( hd )->protect = false;
+        guard_ptr( hd )->dirty_addr = NULL;
+    }
+    hd->gen++;
+    hd->magic.c = MAGIC_START;
+    hd->magic.sum = payload_size;
     t_mem_sentinel *s = sentinel_ptr( hd );
     s->magic = hd->magic;
     hd->allocated.file = file;
     hd->allocated.line = line;
     hd->last_checked = hd->allocated;
     hd->free = false;
+    hd->parent = NULL;
+    hd->children = NULL;
+    hd->next_sibling = NULL;
+    hd->prev_sibling = NULL;
+}
 
-    if(context){
-        bool range;
-        bool magic;
-        check_ptr(context, &range, &magic, NULL);
-        assert(range && magic);
-        if(range && magic) {
-            t_mem_hd *  parent = header_ptr(context);
-            t_mem_lst * lst = malloc(sizeof(t_mem_lst));
-            lst->chunk = hd;
-            lst->next = parent->children;
-            parent->children = lst;
+/**
+ * @brief resolves a context pointer to its header.
+ *
+ * @return the header or NULL if there is no context.
+ */
+static t_mem_hd *mem_context( void *context ) {
+    if( context == NULL )
+        return NULL;
+    bool range;
+    bool magic;
+    check_ptr( context, &range, &magic, NULL );
+    assert( range && magic );
+    return ( range && magic ) ? header_ptr( context ) : NULL;
+}
+
+/**
+ * @brief makes hd a child of parent.
+ */
+static void mem_attach( t_mem_hd * parent, t_mem_hd * hd ) {
+    if( parent == NULL )
+        return;
+    hd->parent = parent;
+    hd->prev_sibling = NULL;
+    hd->next_sibling = parent->children;
+    if( parent->children )
+        parent->children->prev_sibling = hd;
+    parent->children = hd;
+}
+
+/**
+ * @brief removes hd from the children of its parent.
+ */
+static void mem_detach( t_mem_hd * hd ) {
+    if( hd->parent == NULL )
+        return;
+    if( hd->prev_sibling )
+        hd->prev_sibling->next_sibling = hd->next_sibling;
+    else
+        hd->parent->children = hd->next_sibling;
+    if( hd->next_sibling )
+        hd->next_sibling->prev_sibling = hd->prev_sibling;
+    hd->parent = NULL;
+    hd->next_sibling = NULL;
+    hd->prev_sibling = NULL;
+}
+
+/**
+ * @brief the budget attached to a context.
+ *
+ * @return the budget or NULL if hd does not have the budgeted flag.
+ */
+static t_mem_budget *mem_budget_owned( t_mem_hd * hd ) {
+    if( !hd->budgeted )
+        return NULL;
+    t_mem_budget *b = g_budgets;
+    while( b->owner != hd )
+        b = b->next;
+    return b;
+}
+
+/**
+ * @brief the budget a chunk allocated in hd is charged to.
+ *
+ * @return the budget of the closest budgeted context, NULL if there is none.
+ */
+static t_mem_budget *mem_budget_of( t_mem_hd * hd ) {
+    for( ; hd; hd = hd->parent ) {
+        if( hd->budgeted )
+            return mem_budget_owned( hd );
+    }
+    return NULL;
+}
+
+/**
+ * @brief removes a budget from the list of all budgets and frees it.
+ */
+static void mem_budget_drop( t_mem_budget * b ) {
+    t_mem_budget **p = &g_budgets;
+    while( *p != b )
+        p = &( *p )->next;
+    *p = b->next;
+    b->owner->budgeted = false;
+    free( b );
+}
+
+/**
+ * @brief checks whether bytes can be charged to a budget.
+ *
+ * @return true if no hard limit along the chain of budgets is exceeded.
+ */
+static bool mem_budget_fits( t_mem_budget * b, size_t bytes ) {
+    for( ; b; b = b->parent ) {
+        if( b->hard && b->used + bytes > b->hard )
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief charges bytes to a budget and its enclosing budgets.
+ *
+ * The soft limit callback is raised once when the usage crosses the soft
+ * limit. It is raised again only after the usage dropped below it.
+ */
+static void mem_budget_charge( t_mem_budget * b, size_t bytes ) {
+    for( ; b; b = b->parent ) {
+        b->used += bytes;
+        if( b->soft && b->used > b->soft && !b->signalled ) {
+            b->signalled = true;
+            if( b->fn )
+                b->fn( payload_ptr( b->owner ), b->used, b->soft, b->user );
+        }
+    }
+}
+
+static void mem_budget_uncharge( t_mem_budget * b, size_t bytes ) {
+    for( ; b; b = b->parent ) {
+        b->used -= bytes;
+        if( b->used <= b->soft )
+            b->signalled = false;
+    }
+}
+
+/**
+ * @brief puts a chunk and all its children on the free list.
+ *
+ * The chunk has to be detached from its parent by the caller, who passes
+ * the budget the chunk was charged to before, see mem_budget_of.
+ */
+static void mem_release( t_mem_hd * hd, t_mem_budget * budget,
+                         const char *file, int line ) {
+    if( hd->budgeted )
+        budget = mem_budget_owned( hd );
+    t_mem_hd *child = hd->children;
+    while( child ) {
+        t_mem_hd *next = child->next_sibling;
+        child->parent = NULL;
+        mem_release( child, budget, file, line );
+        child = next;
+    }
+    hd->children = NULL;
+    if( hd->guarded )
+        mem_unprotect( hd );
+    if( budget ) {
+        mem_budget_uncharge( budget, hd->size );
+        if( budget->owner == hd )
+            mem_budget_drop( budget );
+    }
+    hd->free = true;
+    hd->gen++;
+    hd->freed.file = file;
+    hd->freed.line = line;
+    if( hd->type ) {
+        t_mem_type *t = &g_types[hd->type];
+        hd->next_free = t->free_list;
+        t->free_list = hd;
+        t->live--;
+        t->pooled++;
+    }
+    else {
+        hd->next_free = g_free_list;
+        g_free_list = hd;
+    }
+}
+
+/**
+ * @brief length of the write protected part of a guarded chunk.
+ *
+ * That is the payload and the sentinel, rounded up to whole pages.
+ */
+static size_t mem_guarded_span( t_mem_hd * hd ) {
+    return hd->size - g_os_page;
+}
+
+/**
+ * @brief size of the mapping needed for a guarded chunk.
+ *
+ * The header sits at the end of the first page, so the payload starts on
+ * a page boundary and the header stays writable while the payload is
+ * protected.
+ */
+static size_t mem_guarded_size( size_t payload_size ) {
+    size_t os_page = mem_os_page(  );
+    size_t span = payload_size + sizeof( t_mem_sentinel );
+    span = ( span + os_page - 1 ) / os_page * os_page;
+    return os_page + span;
+}
+
+static void mem_unprotect( t_mem_hd * hd ) {
+    if( guard_ptr( hd )->protect ) {
+        mprotect( payload_ptr( hd ), mem_guarded_span( hd ),
+                  PROT_READ | PROT_WRITE );
+        guard_ptr( hd )->protect = false;
+    }
+}
+
+/**
+ * @brief records the first write into a protected payload.
+ *
+ * The page protection is lifted and the write is repeated when the
+ * handler returns. Faults outside of guarded chunks are passed on to the
+ * previous handler.
+ */
+static void mem_guard_fault( int sig, siginfo_t * info, void *uctx ) {
+    char *addr = info->si_addr;
+    t_mem_hd *hd = __atomic_load_n( &g_guarded, __ATOMIC_ACQUIRE );
+    for( ; hd; hd = guard_ptr( hd )->next ) {
+        char *start = payload_ptr( hd );
+        if( guard_ptr( hd )->protect && start <= addr
+            && addr < start + mem_guarded_span( hd ) ) {
+            mem_unprotect( hd );
+            guard_ptr( hd )->dirty_addr = addr;
+            return;
+        }
+    }
+    if( g_old_segv.sa_flags & SA_SIGINFO ) {
+        g_old_segv.sa_sigaction( sig, info, uctx );
+    }
+    else if( g_old_segv.sa_handler != SIG_DFL
+             && g_old_segv.sa_handler != SIG_IGN ) {
+        g_old_segv.sa_handler( sig );
+    }
+    else {
+        // the faulting access is repeated and ends the process as usual
+        sigaction( SIGSEGV, &g_old_segv, NULL );
+    }
+}
+
+/**
+ * @brief maps fresh memory for a guarded chunk.
+ *
+ * @return the header of the chunk or NULL
+ */
+static t_mem_hd *mem_map_guarded( size_t size ) {
+    if( !g_segv_installed ) {
+        // cached before the handler can run, it must not call sysconf
+        mem_os_page(  );
+        struct sigaction sa;
+        memset( &sa, 0, sizeof( sa ) );
+        sa.sa_sigaction = mem_guard_fault;
+        sa.sa_flags = SA_SIGINFO;
+        sigemptyset( &sa.sa_mask );
+        if( sigaction( SIGSEGV, &sa, &g_old_segv ) )
+            return NULL;
+        g_segv_installed = true;
+    }
+    char *base = mmap( NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( base == MAP_FAILED )
+        return NULL;
+    mem_adjust_limits( base, size );
+    t_mem_hd *hd = ( t_mem_hd * ) ( base + g_os_page
+                                    - sizeof( t_mem_hd ) );
+    guard_ptr( hd )->next = g_guarded;
+    __atomic_store_n( &g_guarded, hd, __ATOMIC_RELEASE );
+    return hd;
+}
+
+/**
+ * @brief hands out a chunk for count elements of the given size.
+ *
+ * @param zero      clear the requested length of the payload
+ * @param guarded   place the payload on its own pages, see mem_guarded
+ * @return the header or NULL if the budget of the context is exhausted
+ */
+static t_mem_hd *mem_new_chunk( void *context, int size, int count,
+                                bool zero, bool guarded,
+                                const char *file, int line ) {
+    size_t payload_size = size * count;
+    size_t page_size = guarded ? mem_guarded_size( payload_size )
+            : mem_page_size( payload_size );
+    t_mem_hd *parent = mem_context( context );
+    t_mem_budget *budget = mem_budget_of( parent );
+
+    if( !mem_budget_fits( budget, page_size ) )
+        return NULL;
+    
+    t_mem_hd *hd = mem_find_free_chunk(page_size, guarded);
+    if(hd == NULL){ 
+        if( guarded ) {
+            hd = mem_map_guarded( page_size );
+        }
+        else {
+            hd = malloc( page_size );
+            if( hd )
+                mem_adjust_limits((char*)hd, page_size);
+        }
+        if( hd == NULL )
+            return NULL;
+        hd->next = g_chunks;
+        g_chunks = hd;    
+        hd->size = page_size;
+        hd->guarded = guarded;
+        hd->gen = 0;
+    }
+
+    mem_init_chunk( hd, payload_size, zero, file, line );
+    mem_attach( parent, hd );
+    mem_budget_charge( budget, page_size );
+    return hd;
+}
+
+static void *mem_alloc( void *context, int size, int count,
+                        const char *file, int line ) {
+    t_mem_hd *hd = mem_new_chunk( context, size, count, false, false,
+                                  file, line );
+    return hd ? payload_ptr( hd ) : NULL;
+}
+
+static void *mem_zero( void *context, int size, int count,
+                       const char *file, int line ) {
+    t_mem_hd *hd = mem_new_chunk( context, size, count, true, false,
+                                  file, line );
+    return hd ? payload_ptr( hd ) : NULL;
+}
+
+/**
+ * @brief allocates a zeroed chunk whose payload is tracked by page protection.
+ *
+ * The payload starts on a page boundary and fills whole pages. After a
+ * checkpoint these pages are write protected. The first write afterwards
+ * is caught by a SIGSEGV handler, which lifts the protection and marks the
+ * chunk dirty. Checking such a chunk for changes is then O(1) instead of
+ * a checksum over the whole payload. Meant for large buffers that rarely
+ * change.
+ */
+static void *mem_guarded( void *context, int size, int count,
+                          const char *file, int line ) {
+    t_mem_hd *hd = mem_new_chunk( context, size, count, true, true,
+                                  file, line );
+    return hd ? payload_ptr( hd ) : NULL;
+}
+
+/**
+ * @brief distance of two chunks of a type in its slabs.
+ *
+ * Slabs hold only one size, so there is no need to round up to a page
+ * size. Rounding to the strictest alignment keeps every payload aligned.
+ */
+static size_t mem_slab_stride( size_t size ) {
+    size_t align = _Alignof( max_align_t );
+    size_t total = sizeof( t_mem_hd ) + size + sizeof( t_mem_sentinel );
+    return ( total + align - 1 ) / align * align;
+}
+
+/**
+ * @brief registers a type, or looks up an already registered one.
+ *
+ * @return the type id, ids start at 1, 0 if no more types fit into
+ *         MEM_TYPE_BITS or memory ran out
+ */
+static int mem_register_type( const char *name, size_t size ) {
+    for( int id = 1; id < g_type_count; id++ ) {
+        if( strcmp( g_types[id].name, name ) == 0 ) {
+            assert( g_types[id].size == size );
+            return id;
         }
     }
+    if( g_type_count >= 1 << MEM_TYPE_BITS )
+        return 0;
+    t_mem_type *types = realloc( g_types, ( g_type_count + 1 )
+                                 * sizeof( t_mem_type ) );
+    if( types == NULL )
+        return 0;
+    g_types = types;
+    t_mem_type *t = &g_types[g_type_count];
+    memset( t, 0, sizeof( *t ) );
+    t->name = name;
+    t->size = size;
+    t->page_size = mem_slab_stride( size );
+    return g_type_count++;
+}
+
+/**
+ * @brief fills the pool of a type with a new slab of chunks.
+ */
+static bool mem_type_refill( t_mem_type * t, const char *file, int line ) {
+    char *slab = malloc( MEM_SLAB_CHUNKS * t->page_size );
+    if( slab == NULL )
+        return false;
+    mem_adjust_limits( slab, MEM_SLAB_CHUNKS * t->page_size );
+    // chain backwards, so chunks are handed out in address order
+    for( int i = MEM_SLAB_CHUNKS - 1; i >= 0; i-- ) {
+        t_mem_hd *hd = ( t_mem_hd * ) ( slab + i * t->page_size );
+        hd->size = t->page_size;
+        hd->guarded = false;
+        hd->gen = 0;
+        mem_init_chunk( hd, 0, false, file, line );
+        hd->type = 0;
+        hd->free = true;
+        hd->freed = hd->allocated;
+        hd->next = g_chunks;
+        g_chunks = hd;
+        hd->next_free = t->free_list;
+        t->free_list = hd;
+    }
+    t->pooled += MEM_SLAB_CHUNKS;
+    t->slabs++;
+    return true;
+}
+
+/**
+ * @brief allocates an object of a registered type from its pool.
+ *
+ * The content is not initialized.
+ */
+static void *mem_alloc_typed( void *context, int id,
+                              const char *file, int line ) {
+    assert( id > 0 && id < g_type_count );
+    t_mem_type *t = &g_types[id];
+    t_mem_hd *parent = mem_context( context );
+    t_mem_budget *budget = mem_budget_of( parent );
+
+    if( !mem_budget_fits( budget, t->page_size ) )
+        return NULL;
+    if( t->free_list == NULL && !mem_type_refill( t, file, line ) )
+        return NULL;
+
+    t_mem_hd *hd = t->free_list;
+    t->free_list = hd->next_free;
+    t->pooled--;
+    t->live++;
+
+    mem_init_chunk( hd, t->size, false, file, line );
+    hd->type = id;
+    mem_attach( parent, hd );
+    mem_budget_charge( budget, t->page_size );
+    return payload_ptr( hd );
+}
+
+/**
+ * @brief checked downcast of a chunk to a registered type.
+ *
+ * @return ptr if the chunk is a live object of the given type, NULL otherwise.
+ */
+static void *mem_get_type( void *ptr, int type ) {
+    bool range;
+    bool magic;
+
+    check_ptr( ptr, &range, &magic, NULL );
+    if( range && magic ) {
+        t_mem_hd *hd = header_ptr( ptr );
+        if( !hd->free && hd->type == type )
+            return ptr;
+    }
+    return NULL;
+}
+
+/**
+ * @brief usage numbers of the pool of a type.
+ *
+ * @return false if the type is not registered.
+ */
+static bool mem_type_stats( int id, struct bc_mem_type_stats *stats ) {
+    if( id <= 0 || id >= g_type_count )
+        return false;
+    t_mem_type *t = &g_types[id];
+    stats->name = t->name;
+    stats->size = t->size;
+    stats->live = t->live;
+    stats->pooled = t->pooled;
+    stats->slabs = t->slabs;
+    return true;
+}
+
+/**
+ * @brief resizes a chunk by moving its content into a new one.
+ *
+ * Without ptr this is a zeroed allocation. Otherwise the old content is
+ * copied and only the part beyond it is zeroed. If the new chunk cannot
+ * be allocated, NULL is returned and ptr stays untouched.
+ */
+static void *mem_realloc( void *context, void *ptr, int size, int count,
+                          const char *file, int line ) {
+    t_mem_hd *hd = mem_new_chunk( context, size, count, ptr == NULL, false,
+                                  file, line );
+    if( hd == NULL )
+        return NULL;
 
     if(ptr){
         t_mem_hd *oldhd = header_ptr(ptr);
-        memcpy(hd->data, ptr, oldhd->len);
+        size_t copied = oldhd->len < hd->len ? oldhd->len : hd->len;
+        memcpy(hd->data, ptr, copied);
+        memset((char*)hd->data + copied, 0, hd->len - copied);
         mem_checkpoint(hd->data, file, line);
         mem_unlink(ptr, file, line);
     }
@@ -263,18 +964,101 @@ static void *mem_realloc( void *context, void *ptr, int size, int count,
     return payload_ptr( hd );
 }
 
+/**
+ * @brief allocates n chunks of the same size in one go.
+ *
+ * The page size and the context are resolved only once. Chunks are taken
+ * from the free list in a single pass over it, the remaining ones are
+ * carved out of one fresh block of memory. Like bc_mem_alloc the payloads
+ * are not initialized. If the budget of the context does not allow all
+ * n chunks, only as many as fit are allocated.
+ *
+ * @param out   receives the n pointers to the payloads
+ * @return number of chunks allocated
+ */
+static int mem_alloc_batch( void *context, int size, int count, int n,
+                            void **out, const char *file, int line ) {
+    size_t payload_size = size * count;
+    size_t page_size = mem_page_size( payload_size );
+    t_mem_hd *parent = mem_context( context );
+    t_mem_budget *budget = mem_budget_of( parent );
+    int done = 0;
+
+    for( t_mem_budget *b = budget; b; b = b->parent ) {
+        if( b->hard ) {
+            size_t room = b->used < b->hard ? b->hard - b->used : 0;
+            if( room / page_size < ( size_t )n )
+                n = room / page_size;
+        }
+    }
+
+    t_mem_hd *prev_hd = NULL;
+    t_mem_hd *hd = g_free_list;
+    while( hd && done < n ) {
+        t_mem_hd *next = hd->next_free;
+        if( hd->size == page_size && !hd->guarded ) {
+            if( prev_hd ) prev_hd->next_free = next;
+            else g_free_list = next;
+            out[done++] = hd;
+        }
+        else {
+            prev_hd = hd;
+        }
+        hd = next;
+    }
+
+    if( done < n ) {
+        char *block = malloc( ( n - done ) * page_size );
+        if( block ) {
+            mem_adjust_limits( block, ( n - done ) * page_size );
+            for( char *m = block; done < n; m += page_size ) {
+                hd = ( t_mem_hd * ) m;
+                hd->size = page_size;
+                hd->guarded = false;
+                hd->gen = 0;
+                hd->next = g_chunks;
+                g_chunks = hd;
+                out[done++] = hd;
+            }
+        }
+    }
+
+    for( int i = 0; i < done; i++ ) {
+        hd = out[i];
+        mem_init_chunk( hd, payload_size, false, file, line );
+        mem_attach( parent, hd );
+        out[i] = payload_ptr( hd );
+    }
+    mem_budget_charge( budget, done * page_size );
+    return done;
+}
+
 static void mem_checkpoint( void *ptr, const char *file, int line ) {
     bool range;
     bool magic;
 
     check_ptr( ptr, &range, &magic, NULL );
 
-    if( range && magic ) {
+    if( range && magic && header_ptr( ptr )->guarded ) {
+        // no checksum needed, any later write is caught by the protection
+        t_mem_hd *hd = header_ptr( ptr );
+        guard_ptr( hd )->dirty_addr = NULL;
+        hd->reported = false;
+        hd->gen++;
+        hd->last_checked.file = file;
+        hd->last_checked.line = line;
+        guard_ptr( hd )->protect = true;
+        mprotect( payload_ptr( hd ), mem_guarded_span( hd ), PROT_READ );
+    }
+    else if( range && magic ) {
         t_mem_hd *hd = header_ptr( ptr );
         t_mem_sentinel *sentinel = sentinel_ptr( hd );
-        t_magic m = calculate_magic( hd );
+        t_magic m = calculate_magic( hd, hd->len );
         hd->magic = m;
         sentinel->magic = m;
+        hd->sealed = true;
+        hd->reported = false;
+        hd->gen++;
         hd->last_checked.file = file;
         hd->last_checked.line = line;
     }
@@ -288,20 +1072,104 @@ static void* mem_unlink( void *ptr, const char *file, int line ) {
     assert(range && magic);
     if( range && magic ) {
         t_mem_hd *hd = header_ptr( ptr );
-        for(t_mem_lst *child = hd->children; child; child = child->next){
-            (void) mem_unlink(child->chunk->data, file, line);
-        }        
-
-        hd->free = true;
-        hd->freed.file = file;
-        hd->freed.line = line;
-        hd->next_free = g_free_list;
-        g_free_list = hd;
+        if( hd->free ) {
+            // already released together with its context
+            return NULL;
+        }
+        t_mem_budget *budget = mem_budget_of( hd->parent );
+        mem_detach( hd );
+        mem_release( hd, budget, file, line );
         return NULL;
     }
     return ptr;
 }
 
+/**
+ * @brief sums up the pages of a context that are charged to a new budget nb.
+ *
+ * Nested budgets keep their chunks and are linked to nb instead.
+ */
+static size_t mem_budget_adopt( t_mem_hd * hd, t_mem_budget * nb ) {
+    if( hd->budgeted ) {
+        // nested budget, all of its usage is charged to the new one
+        t_mem_budget *b = mem_budget_owned( hd );
+        b->parent = nb;
+        return b->used;
+    }
+    size_t used = hd->size;
+    for( t_mem_hd *child = hd->children; child; child = child->next_sibling )
+        used += mem_budget_adopt( child, nb );
+    return used;
+}
+
+/**
+ * @brief attaches a budget to a context or changes its limits.
+ *
+ * The context itself and everything allocated in it so far is charged
+ * right away.
+ */
+static void mem_budget( void *ctx, size_t soft, size_t hard,
+                        bc_mem_budget_fn fn, void *user ) {
+    t_mem_hd *hd = mem_context( ctx );
+    if( hd == NULL )
+        return;
+    t_mem_budget *b = mem_budget_owned( hd );
+    if( b == NULL ) {
+        b = calloc( 1, sizeof( t_mem_budget ) );
+        b->owner = hd;
+        b->parent = mem_budget_of( hd->parent );
+        b->used = mem_budget_adopt( hd, b );
+        hd->budgeted = true;
+        b->next = g_budgets;
+        g_budgets = b;
+    }
+    b->soft = soft;
+    b->hard = hard;
+    b->fn = fn;
+    b->user = user;
+    // a context may already be above a new or lowered soft limit
+    bool over = soft && b->used > soft;
+    if( over && !b->signalled && fn )
+        fn( payload_ptr( hd ), b->used, soft, user );
+    b->signalled = over;
+}
+
+/**
+ * @brief bytes charged to the budget the context belongs to.
+ *
+ * @return the usage or 0 if the context is not under any budget.
+ */
+static size_t mem_usage( void *ctx ) {
+    t_mem_budget *b = mem_budget_of( mem_context( ctx ) );
+    return b ? b->used : 0;
+}
+
+/**
+ * @brief releases n chunks in one pass.
+ *
+ * Every entry of ptrs is set to NULL once its chunk has been released.
+ */
+static void mem_unlink_batch( void **ptrs, int n, const char *file, int line ) {
+    for( int i = 0; i < n; i++ ) {
+        bool range;
+        bool magic;
+
+        if( ptrs[i] == NULL )
+            continue;
+        check_ptr( ptrs[i], &range, &magic, NULL );
+        assert( range && magic );
+        if( !( range && magic ) )
+            continue;
+        t_mem_hd *hd = header_ptr( ptrs[i] );
+        if( !hd->free ) {
+            t_mem_budget *budget = mem_budget_of( hd->parent );
+            mem_detach( hd );
+            mem_release( hd, budget, file, line );
+        }
+        ptrs[i] = NULL;
+    }
+}
+
 
 static void mem_report(  void ) {
     char status[80];
@@ -320,18 +1188,23 @@ static void mem_report(  void ) {
                         magic ? "" : "corrupted ",
                         ( !magic || sum ) ? "" : "modified ");
         fprintf( stderr, "%5d %p %6llu %6llu %-20s  %s(%d)", no, hd,
-                 hd->len, hd->size, status, hd->allocated.file,
+                 ( unsigned long long )hd->len,
+                 ( unsigned long long )hd->size, status, hd->allocated.file,
                  hd->allocated.line);
         no++;
-        if( hd->allocated.file == hd->last_checked.file
-            && hd->allocated.line == hd->last_checked.line ) {
+        if( hd->free || ( hd->allocated.file == hd->last_checked.file
+            && hd->allocated.line == hd->last_checked.line ) ) {
             }                 
             else {
                 fprintf(stderr, " / %s(%d)",
                             hd->last_checked.file,
                             hd->last_checked.line );
             }
-        if(hd->freed.file) {
+        if(hd->guarded && guard_ptr(hd)->dirty_addr) {
+            fprintf(stderr, " written at +%ld",
+                    (long)((char*)guard_ptr(hd)->dirty_addr - (char*)payload_ptr(hd)));
+        }
+        if(hd->free) {
                             fprintf(stderr, " v %s(%d)",
                             hd->freed.file,
                             hd->freed.line );
@@ -342,11 +1215,360 @@ static void mem_report(  void ) {
     fprintf( stderr, "*** end of report ***\n" );
 }
 
-void bc_mem_init(  ) {
-    g_mem.realloc = mem_realloc;
-    g_mem.unlink = mem_unlink;
-    g_mem.is_valid = mem_is_valid;
-    g_mem.checkpoint = mem_checkpoint;
-    g_mem.report = mem_report;
+/** chunks the scrubber takes out of the bookkeeping under one lock */
+#define MEM_SCRUB_BATCH 16
+
+/**
+ * @brief checks the next chunks after the cursor.
+ *
+ * The lock is only held to take a batch of chunks from the bookkeeping
+ * and to confirm the results, the checksums are computed without it.
+ * Chunks are never given back to the system, so their payload can be
+ * read at any time. A chunk that is released, reused or checkpointed in
+ * the meantime changes its gen and its result is dropped.
+ * A call ends at the end of the chunk list, the next one starts over.
+ *
+ * @param count     number of chunks to check
+ * @return the number of violations reported
+ */
+static unsigned mem_scrub_step( unsigned count ) {
+    struct {
+        t_mem_hd *hd;
+        unsigned gen;
+        size_t len;
+        unsigned int sum;
+    } batch[MEM_SCRUB_BATCH];
+    struct {
+        void *ptr;
+        int kind;
+        t_location allocated;
+    } found[MEM_SCRUB_BATCH];
+    unsigned reported = 0;
+    bool end = false;
+    bc_mem_scrub_fn fn = NULL;
+    void *user = NULL;
+
+    while( count > 0 && !end ) {
+        int n = 0;
+        int nfound = 0;
+
+        mem_lock(  );
+        if( !g_scrub.active ) {
+            mem_unlock(  );
+            break;
+        }
+        fn = g_scrub.fn;
+        user = g_scrub.user;
+        if( g_scrub.cursor == NULL )
+            g_scrub.cursor = g_chunks;
+        while( count > 0 && n + nfound < MEM_SCRUB_BATCH ) {
+            t_mem_hd *hd = g_scrub.cursor;
+            if( hd == NULL ) {
+                end = true;
+                break;
+            }
+            g_scrub.cursor = hd->next;
+            end = g_scrub.cursor == NULL;
+            count--;
+            if( hd->free || hd->reported )
+                continue;
+
+            bool range;
+            bool magic;
+            bool sum = true;
+            // guarded and unsealed chunks need no checksum
+            bool cheap = hd->guarded || !hd->sealed;
+            check_ptr( payload_ptr( hd ), &range, &magic,
+                       cheap ? &sum : NULL );
+            if( !magic || !sum ) {
+                hd->reported = true;
+                found[nfound].ptr = payload_ptr( hd );
+                found[nfound].kind = magic ? BC_MEM_MODIFIED : BC_MEM_CORRUPTED;
+                found[nfound].allocated = hd->allocated;
+                nfound++;
+            }
+            else if( !cheap ) {
+                batch[n].hd = hd;
+                batch[n].gen = hd->gen;
+                batch[n].len = hd->len;
+                batch[n].sum = hd->magic.sum;
+                n++;
+            }
+            if( end )
+                break;
+        }
+        mem_unlock(  );
+
+        bool modified[MEM_SCRUB_BATCH];
+        for( int i = 0; i < n; i++ )
+            modified[i] = calculate_magic( batch[i].hd, batch[i].len ).sum
+                    != batch[i].sum;
+
+        if( n > 0 ) {
+            mem_lock(  );
+            for( int i = 0; i < n; i++ ) {
+                t_mem_hd *hd = batch[i].hd;
+                if( !modified[i] || hd->gen != batch[i].gen || hd->reported )
+                    continue;
+                hd->reported = true;
+                found[nfound].ptr = payload_ptr( hd );
+                found[nfound].kind = BC_MEM_MODIFIED;
+                found[nfound].allocated = hd->allocated;
+                nfound++;
+            }
+            mem_unlock(  );
+        }
+
+        for( int i = 0; i < nfound; i++ ) {
+            fn( found[i].ptr, found[i].kind, found[i].allocated.file,
+                found[i].allocated.line, user );
+        }
+        reported += nfound;
+    }
+    return reported;
+}
+
+static void *mem_scrub_thread( void *arg ) {
+    ( void )arg;
+    // check in slices every 10ms to spread the work, below 100 chunks per
+    // second one chunk at a time with a longer wait
+    unsigned slice = g_scrub.rate / 100 ? g_scrub.rate / 100 : 1;
+    long wait_ns = g_scrub.rate >= 100 ? 10000000 : 1000000000 / g_scrub.rate;
+    pthread_mutex_lock( &g_scrub.lock );
+    while( g_scrub.running ) {
+        pthread_mutex_unlock( &g_scrub.lock );
+        mem_scrub_step( slice );
+        pthread_mutex_lock( &g_scrub.lock );
+
+        struct timespec until;
+        clock_gettime( CLOCK_REALTIME, &until );
+        until.tv_nsec += wait_ns;
+        while( until.tv_nsec >= 1000000000 ) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        if( g_scrub.running )
+            pthread_cond_timedwait( &g_scrub.wake, &g_scrub.lock, &until );
+    }
+    pthread_mutex_unlock( &g_scrub.lock );
+    return NULL;
 }
 
+/**
+ * @brief starts the scrubber.
+ *
+ * The first start turns on locking, see mem_locking_on. The scrubber walks all chunks over and over and checks header and
+ * sentinel magic and, for checkpointed chunks, the checksum. A violation
+ * is reported once per chunk until the chunk is checkpointed again.
+ *
+ * @param rate  number of chunks checked per second by a background thread,
+ *              0 starts no thread, the chunks are then only checked by
+ *              mem_scrub_step
+ * @param fn    called for each violation, from the thread that checked
+ * @return false if the scrubber is already running or cannot be started
+ */
+static bool mem_scrub_start( unsigned rate, bc_mem_scrub_fn fn, void *user ) {
+    if( fn == NULL )
+        return false;
+    mem_locking_on(  );
+    mem_lock(  );
+    bool ok = !g_scrub.active;
+    if( ok ) {
+        g_scrub.active = true;
+        g_scrub.rate = rate;
+        g_scrub.fn = fn;
+        g_scrub.user = user;
+        g_scrub.cursor = NULL;
+    }
+    mem_unlock(  );
+    if( ok && rate > 0 ) {
+        pthread_mutex_lock( &g_scrub.lock );
+        g_scrub.running = true;
+        if( pthread_create( &g_scrub.thread, NULL, mem_scrub_thread, NULL ) ) {
+            g_scrub.running = false;
+            ok = false;
+        }
+        pthread_mutex_unlock( &g_scrub.lock );
+        if( !ok ) {
+            mem_lock(  );
+            g_scrub.active = false;
+            mem_unlock(  );
+        }
+    }
+    return ok;
+}
+
+/**
+ * @brief stops the scrubber and waits for its thread to finish.
+ */
+static void mem_scrub_stop( void ) {
+    pthread_mutex_lock( &g_scrub.lock );
+    bool running = g_scrub.running;
+    g_scrub.running = false;
+    pthread_cond_signal( &g_scrub.wake );
+    pthread_mutex_unlock( &g_scrub.lock );
+    if( running )
+        pthread_join( g_scrub.thread, NULL );
+    mem_lock(  );
+    g_scrub.active = false;
+    mem_unlock(  );
+}
+
+/**
+ * @name mem_std
+ * @brief the entry points of the default implementation.
+ *
+ * These are installed in g_mem by bc_mem_init and are the targets of the
+ * calling macros when the library is built with BC_MEM_STATIC=mem_std.
+ * Each one holds the lock while locking is on, except the scrubber calls,
+ * which take it themselves for as short as possible.
+ * @{
+ */
+void *mem_std_realloc( void *ctx, void *p, int type, int count,
+                       const char *file, int line ) {
+    mem_lock(  );
+    void *r = mem_realloc( ctx, p, type, count, file, line );
+    mem_unlock(  );
+    return r;
+}
+
+void *mem_std_alloc( void *ctx, int type, int count, const char *file,
+                     int line ) {
+    mem_lock(  );
+    void *r = mem_alloc( ctx, type, count, file, line );
+    mem_unlock(  );
+    return r;
+}
+
+void *mem_std_zero( void *ctx, int type, int count, const char *file,
+                    int line ) {
+    mem_lock(  );
+    void *r = mem_zero( ctx, type, count, file, line );
+    mem_unlock(  );
+    return r;
+}
+
+void *mem_std_guarded( void *ctx, int type, int count, const char *file,
+                       int line ) {
+    mem_lock(  );
+    void *r = mem_guarded( ctx, type, count, file, line );
+    mem_unlock(  );
+    return r;
+}
+
+int mem_std_register_type( const char *name, size_t size ) {
+    mem_lock(  );
+    int r = mem_register_type( name, size );
+    mem_unlock(  );
+    return r;
+}
+
+void *mem_std_alloc_typed( void *ctx, int id, const char *file, int line ) {
+    mem_lock(  );
+    void *r = mem_alloc_typed( ctx, id, file, line );
+    mem_unlock(  );
+    return r;
+}
+
+void *mem_std_get_type( void *ptr, int type ) {
+    mem_lock(  );
+    void *r = mem_get_type( ptr, type );
+    mem_unlock(  );
+    return r;
+}
+
+bool mem_std_type_stats( int id, struct bc_mem_type_stats *stats ) {
+    mem_lock(  );
+    bool r = mem_type_stats( id, stats );
+    mem_unlock(  );
+    return r;
+}
+
+int mem_std_alloc_batch( void *ctx, int type, int count, int n, void **out,
+                         const char *file, int line ) {
+    mem_lock(  );
+    int r = mem_alloc_batch( ctx, type, count, n, out, file, line );
+    mem_unlock(  );
+    return r;
+}
+
+void mem_std_budget( void *ctx, size_t soft, size_t hard,
+                     bc_mem_budget_fn fn, void *user ) {
+    mem_lock(  );
+    mem_budget( ctx, soft, hard, fn, user );
+    mem_unlock(  );
+}
+
+size_t mem_std_usage( void *ctx ) {
+    mem_lock(  );
+    size_t r = mem_usage( ctx );
+    mem_unlock(  );
+    return r;
+}
+
+void *mem_std_unlink( void *ptr, const char *file, int line ) {
+    mem_lock(  );
+    void *r = mem_unlink( ptr, file, line );
+    mem_unlock(  );
+    return r;
+}
+
+void mem_std_unlink_batch( void **ptrs, int n, const char *file, int line ) {
+    mem_lock(  );
+    mem_unlink_batch( ptrs, n, file, line );
+    mem_unlock(  );
+}
+
+void mem_std_checkpoint( void *ptr, const char *file, int line ) {
+    mem_lock(  );
+    mem_checkpoint( ptr, file, line );
+    mem_unlock(  );
+}
+
+bool mem_std_is_valid( void *ptr ) {
+    mem_lock(  );
+    bool r = mem_is_valid( ptr );
+    mem_unlock(  );
+    return r;
+}
+
+void mem_std_report( void ) {
+    mem_lock(  );
+    mem_report(  );
+    mem_unlock(  );
+}
+
+bool mem_std_scrub_start( unsigned rate, bc_mem_scrub_fn fn, void *user ) {
+    return mem_scrub_start( rate, fn, user );
+}
+
+void mem_std_scrub_stop( void ) {
+    mem_scrub_stop(  );
+}
+
+unsigned mem_std_scrub_step( unsigned count ) {
+    return mem_scrub_step( count );
+}
+/** @} */
+
+void bc_mem_init(  ) {
+    g_mem.realloc = mem_std_realloc;
+    g_mem.alloc = mem_std_alloc;
+    g_mem.zero = mem_std_zero;
+    g_mem.guarded = mem_std_guarded;
+    g_mem.alloc_batch = mem_std_alloc_batch;
+    g_mem.register_type = mem_std_register_type;
+    g_mem.alloc_typed = mem_std_alloc_typed;
+    g_mem.get_type = mem_std_get_type;
+    g_mem.type_stats = mem_std_type_stats;
+    g_mem.unlink = mem_std_unlink;
+    g_mem.unlink_batch = mem_std_unlink_batch;
+    g_mem.budget = mem_std_budget;
+    g_mem.usage = mem_std_usage;
+    g_mem.is_valid = mem_std_is_valid;
+    g_mem.checkpoint = mem_std_checkpoint;
+    g_mem.report = mem_std_report;
+    g_mem.scrub_start = mem_std_scrub_start;
+    g_mem.scrub_stop = mem_std_scrub_stop;
+    g_mem.scrub_step = mem_std_scrub_step;
+}
@@ -0,0 +1,366 @@
+/**
+ * @file stats.c
+ * @brief latency histograms of library operations.
+ *
+ * Operations are registered by name and numbered in that order. Each
+ * thread gets one record on its first recording, holding a histogram per
+ * operation that is allocated when the thread first records it. The
+ * records are chained into a list that is never shrunk, only readers walk
+ * it. A record of a thread that has ended is handed to the next new
+ * thread, so the counts it holds stay part of the statistics.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "stats.h"
+
+/** buckets per power of two, as bits */
+#define STATS_SUB_BITS 5
+#define STATS_SUB ( 1u << STATS_SUB_BITS )
+/** latencies are clamped to 2^STATS_MAX_BITS - 1 ns, about 18 minutes */
+#define STATS_MAX_BITS 40
+#define STATS_BUCKETS ( ( STATS_MAX_BITS - STATS_SUB_BITS + 1 ) * STATS_SUB )
+
+/**
+ * @brief histogram of one operation.
+ *
+ * Only the owning thread writes, so relaxed atomic loads and stores
+ * are enough to let other threads read while it is written.
+ */
+typedef struct stats_hist {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[STATS_BUCKETS];
+} t_stats_hist;
+
+typedef struct stats_thread {
+    struct stats_thread *next;  ///< list of all records
+    bool in_use;                ///< owned by a running thread
+    t_stats_hist *hist[BC_STATS_MAX_OPS];  ///< NULL until first recorded
+} t_stats_thread;
+
+bool g_stats_enabled = false;
+
+static t_stats_thread *g_stats_threads = NULL;
+static __thread t_stats_thread *t_stats = NULL;
+static pthread_key_t g_stats_key;
+static pthread_once_t g_stats_once = PTHREAD_ONCE_INIT;
+
+/** names of the registered operations, g_stats_ops of them */
+static const char *g_stats_names[BC_STATS_MAX_OPS];
+static int g_stats_ops = 0;
+static pthread_mutex_t g_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint64_t bc_stats_now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( uint64_t ) ts.tv_sec * 1000000000u + ( uint64_t ) ts.tv_nsec;
+}
+
+/**
+ * @brief bucket of a latency.
+ *
+ * Values below 2 * STATS_SUB have a bucket each, above that every power
+ * of two is split into STATS_SUB buckets.
+ */
+static unsigned stats_bucket( uint64_t v ) {
+    if( v >= ( 1ull << STATS_MAX_BITS ) )
+        v = ( 1ull << STATS_MAX_BITS ) - 1;
+    if( v < STATS_SUB )
+        return ( unsigned )v;
+    unsigned shift = 63 - __builtin_clzll( v ) - STATS_SUB_BITS;
+    return ( shift + 1 ) * STATS_SUB + ( unsigned )( ( v >> shift ) - STATS_SUB );
+}
+
+/**
+ * @brief highest latency that falls into a bucket.
+ */
+static uint64_t stats_bucket_max( unsigned i ) {
+    if( i < STATS_SUB )
+        return i;
+    unsigned shift = i / STATS_SUB - 1;
+    uint64_t sub = i % STATS_SUB + STATS_SUB;
+    return ( ( sub + 1 ) << shift ) - 1;
+}
+
+/**
+ * @brief marks the record of an ending thread as free for reuse.
+ */
+static void stats_thread_end( void *arg ) {
+    t_stats_thread *t = arg;
+    __atomic_store_n( &t->in_use, false, __ATOMIC_RELEASE );
+}
+
+static void stats_key_init( void ) {
+    pthread_key_create( &g_stats_key, stats_thread_end );
+}
+
+/**
+ * @brief the record of the calling thread, created on first use.
+ *
+ * @return NULL if no memory is left, nothing is recorded then.
+ */
+static t_stats_thread *stats_thread( void ) {
+    if( t_stats )
+        return t_stats;
+    pthread_once( &g_stats_once, stats_key_init );
+
+    t_stats_thread *t = __atomic_load_n( &g_stats_threads, __ATOMIC_ACQUIRE );
+    for( ; t; t = t->next ) {
+        bool expected = false;
+        if( __atomic_compare_exchange_n( &t->in_use, &expected, true, false,
+                                         __ATOMIC_ACQUIRE,
+                                         __ATOMIC_RELAXED ) )
+            break;
+    }
+    if( t == NULL ) {
+        // plain calloc, the memory component is instrumented itself
+        t = calloc( 1, sizeof( *t ) );
+        if( t == NULL )
+            return NULL;
+        t->in_use = true;
+        t->next = __atomic_load_n( &g_stats_threads, __ATOMIC_RELAXED );
+        while( !__atomic_compare_exchange_n( &g_stats_threads, &t->next, t,
+                                             false, __ATOMIC_RELEASE,
+                                             __ATOMIC_RELAXED ) ) ;
+    }
+    pthread_setspecific( g_stats_key, t );
+    t_stats = t;
+    return t;
+}
+
+static void stats_add( uint64_t *counter, uint64_t n ) {
+    __atomic_store_n( counter, __atomic_load_n( counter, __ATOMIC_RELAXED ) + n,
+                      __ATOMIC_RELAXED );
+}
+
+/**
+ * @brief the histogram of an operation in the calling thread's record.
+ *
+ * @return NULL if no memory is left, nothing is recorded then.
+ */
+static t_stats_hist *stats_hist( int op ) {
+    t_stats_thread *t = stats_thread(  );
+    if( t == NULL )
+        return NULL;
+    t_stats_hist *h = t->hist[op];
+    if( h == NULL ) {
+        h = calloc( 1, sizeof( *h ) );
+        if( h == NULL )
+            return NULL;
+        h->min = UINT64_MAX;
+        __atomic_store_n( &t->hist[op], h, __ATOMIC_RELEASE );
+    }
+    return h;
+}
+
+/**
+ * @brief adds the latency of a call started at t0, see bc_stats_begin.
+ */
+void bc_stats_record( int op, uint64_t t0 ) {
+    uint64_t ns = bc_stats_now(  ) - t0;
+    t_stats_hist *h = stats_hist( op );
+    if( h == NULL )
+        return;
+    stats_add( &h->buckets[stats_bucket( ns )], 1 );
+    stats_add( &h->sum, ns );
+    if( ns < __atomic_load_n( &h->min, __ATOMIC_RELAXED ) )
+        __atomic_store_n( &h->min, ns, __ATOMIC_RELAXED );
+    if( ns > __atomic_load_n( &h->max, __ATOMIC_RELAXED ) )
+        __atomic_store_n( &h->max, ns, __ATOMIC_RELAXED );
+    // counted last, a reader never sees more calls than bucket entries
+    __atomic_store_n( &h->count, __atomic_load_n( &h->count,
+                                                  __ATOMIC_RELAXED ) + 1,
+                      __ATOMIC_RELEASE );
+}
+
+/**
+ * @brief the id of a registered operation.
+ *
+ * @return the id or -1 if there is no operation of that name.
+ */
+static int stats_find( const char *name ) {
+    int ops = __atomic_load_n( &g_stats_ops, __ATOMIC_ACQUIRE );
+    for( int op = 0; op < ops; op++ )
+        if( strcmp( g_stats_names[op], name ) == 0 )
+            return op;
+    return -1;
+}
+
+/**
+ * @brief registers an operation, or looks it up if it already exists.
+ *
+ * The name is not copied, it must stay valid, e.g. a string literal.
+ * @return the id of the operation or -1 if BC_STATS_MAX_OPS operations
+ *         are registered already.
+ */
+int bc_stats_register( const char *name ) {
+    pthread_mutex_lock( &g_stats_lock );
+    int op = stats_find( name );
+    if( op < 0 && g_stats_ops < BC_STATS_MAX_OPS ) {
+        op = g_stats_ops;
+        g_stats_names[op] = name;
+        __atomic_store_n( &g_stats_ops, op + 1, __ATOMIC_RELEASE );
+    }
+    pthread_mutex_unlock( &g_stats_lock );
+    return op;
+}
+
+/**
+ * @brief switches the recording on or off.
+ *
+ * Recorded values are kept while the recording is off.
+ */
+void bc_stats_enable( bool on ) {
+    __atomic_store_n( &g_stats_enabled, on, __ATOMIC_RELAXED );
+}
+
+bool bc_stats_enabled( void ) {
+    return __atomic_load_n( &g_stats_enabled, __ATOMIC_RELAXED );
+}
+
+/**
+ * @brief clears all histograms.
+ *
+ * Values recorded by other threads at the same time may survive or be
+ * lost partially.
+ */
+void bc_stats_reset( void ) {
+    t_stats_thread *t = __atomic_load_n( &g_stats_threads, __ATOMIC_ACQUIRE );
+    for( ; t; t = t->next ) {
+        for( int op = 0; op < BC_STATS_MAX_OPS; op++ ) {
+            t_stats_hist *h = __atomic_load_n( &t->hist[op], __ATOMIC_ACQUIRE );
+            if( h == NULL )
+                continue;
+            __atomic_store_n( &h->count, 0, __ATOMIC_RELAXED );
+            __atomic_store_n( &h->sum, 0, __ATOMIC_RELAXED );
+            __atomic_store_n( &h->min, UINT64_MAX, __ATOMIC_RELAXED );
+            __atomic_store_n( &h->max, 0, __ATOMIC_RELAXED );
+            for( unsigned i = 0; i < STATS_BUCKETS; i++ )
+                __atomic_store_n( &h->buckets[i], 0, __ATOMIC_RELAXED );
+        }
+    }
+}
+
+/**
+ * @brief merges the histograms of all threads for one operation.
+ */
+static void stats_merge( int op, t_stats_hist *out ) {
+    memset( out, 0, sizeof( *out ) );
+    out->min = UINT64_MAX;
+    t_stats_thread *t = __atomic_load_n( &g_stats_threads, __ATOMIC_ACQUIRE );
+    for( ; t; t = t->next ) {
+        t_stats_hist *h = __atomic_load_n( &t->hist[op], __ATOMIC_ACQUIRE );
+        if( h == NULL || __atomic_load_n( &h->count, __ATOMIC_ACQUIRE ) == 0 )
+            continue;
+        uint64_t min = __atomic_load_n( &h->min, __ATOMIC_RELAXED );
+        uint64_t max = __atomic_load_n( &h->max, __ATOMIC_RELAXED );
+        if( min < out->min )
+            out->min = min;
+        if( max > out->max )
+            out->max = max;
+        out->sum += __atomic_load_n( &h->sum, __ATOMIC_RELAXED );
+        for( unsigned i = 0; i < STATS_BUCKETS; i++ ) {
+            uint64_t n = __atomic_load_n( &h->buckets[i], __ATOMIC_RELAXED );
+            out->buckets[i] += n;
+            out->count += n;
+        }
+    }
+    if( out->count == 0 )
+        out->min = 0;
+}
+
+/**
+ * @brief latency below which the given percentage of calls stays.
+ */
+static uint64_t stats_hist_percentile( const t_stats_hist *h, double percent ) {
+    if( h->count == 0 )
+        return 0;
+    uint64_t rank = ( uint64_t )( percent / 100.0 * ( double )h->count );
+    if( rank >= h->count )
+        rank = h->count - 1;
+    uint64_t seen = 0;
+    for( unsigned i = 0; i < STATS_BUCKETS; i++ ) {
+        seen += h->buckets[i];
+        if( seen > rank ) {
+            uint64_t v = stats_bucket_max( i );
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+/**
+ * @brief latency below which the given percentage of calls of an
+ * operation stays, e.g. 99.9
+ *
+ * @return the latency in ns or 0 if no call has been recorded.
+ */
+uint64_t bc_stats_percentile( const char *name, double percent ) {
+    int op = stats_find( name );
+    if( op < 0 )
+        return 0;
+    t_stats_hist *h = malloc( sizeof( *h ) );
+    if( h == NULL )
+        return 0;
+    stats_merge( op, h );
+    uint64_t r = stats_hist_percentile( h, percent );
+    free( h );
+    return r;
+}
+
+static void stats_summarize( int op, const t_stats_hist *h,
+                             struct bc_stats_summary *summary ) {
+    summary->name = g_stats_names[op];
+    summary->count = h->count;
+    summary->min = h->min;
+    summary->max = h->max;
+    summary->mean = h->count ? ( double )h->sum / ( double )h->count : 0.0;
+    summary->p50 = stats_hist_percentile( h, 50.0 );
+    summary->p99 = stats_hist_percentile( h, 99.0 );
+    summary->p999 = stats_hist_percentile( h, 99.9 );
+}
+
+/**
+ * @brief latencies of an operation merged over all threads.
+ *
+ * @return false if no operation of that name is registered or the memory
+ *         is exhausted.
+ */
+bool bc_stats_query( const char *name, struct bc_stats_summary *summary ) {
+    int op = stats_find( name );
+    if( op < 0 )
+        return false;
+    t_stats_hist *h = malloc( sizeof( *h ) );
+    if( h == NULL )
+        return false;
+    stats_merge( op, h );
+    stats_summarize( op, h, summary );
+    free( h );
+    return true;
+}
+
+/**
+ * @brief writes the summaries of all operations as JSON.
+ */
+void bc_stats_dump( FILE *out ) {
+    int n = 0;
+    fprintf( out, "{\n  \"latency_ns\": [\n" );
+    int ops = __atomic_load_n( &g_stats_ops, __ATOMIC_ACQUIRE );
+    for( int op = 0; op < ops; op++ ) {
+        struct bc_stats_summary s;
+        if( !bc_stats_query( g_stats_names[op], &s ) )
+            continue;
+        fprintf( out, "%s    {\"name\": \"%s\", \"count\": %llu, "
+                 "\"min\": %llu, \"mean\": %.1f, \"p50\": %llu, "
+                 "\"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+                 n++ ? ",\n" : "", s.name, ( unsigned long long )s.count,
+                 ( unsigned long long )s.min, s.mean,
+                 ( unsigned long long )s.p50, ( unsigned long long )s.p99,
+                 ( unsigned long long )s.p999, ( unsigned long long )s.max );
+    }
+    fprintf( out, "\n  ]\n}\n" );
+}
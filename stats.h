@@ -0,0 +1,83 @@
+/**
+ * @file stats.h
+ * @brief latency histograms of library operations.
+ *
+ * Recording is off by default and is switched on at runtime with
+ * bc_stats_enable. While it is off an instrumented call costs one test
+ * of a flag.
+ *
+ * An operation is known by its name, e.g. "itab_read". The library
+ * records the itab operations itab_insert, itab_read, itab_foreach and
+ * itab_next, the last one per step of an iteration. Built with
+ * BC_MEM_COUNTERS every bc_mem_* call is recorded as mem_<fn>, e.g.
+ * mem_realloc.
+ *
+ * Every thread records into histograms of its own, a query merges the
+ * histograms of all threads. The buckets are log-linear like in an HDR
+ * histogram: each power of two is split into 32 buckets, so reported
+ * values are at most about 3% above the measured ones.
+ */
+#ifndef STATS_H
+#define STATS_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** most operations that can be registered */
+#define BC_STATS_MAX_OPS 64
+
+/** merged latencies of one operation in nanoseconds */
+struct bc_stats_summary {
+    const char *name;           ///< name of the operation
+    uint64_t count;             ///< number of recorded calls
+    uint64_t min;
+    uint64_t max;
+    double mean;
+    uint64_t p50;               ///< median
+    uint64_t p99;
+    uint64_t p999;
+};
+
+void bc_stats_enable(bool on);
+bool bc_stats_enabled(void);
+void bc_stats_reset(void);
+int bc_stats_register(const char *name);
+bool bc_stats_query(const char *name, struct bc_stats_summary *summary);
+uint64_t bc_stats_percentile(const char *name, double percent);
+void bc_stats_dump(FILE *out);
+
+/**
+ * @name recording
+ * @brief used by the instrumented calls, see bc_stats_begin.
+ * @{
+ */
+extern bool g_stats_enabled;
+uint64_t bc_stats_now(void);
+void bc_stats_record(int id, uint64_t t0);
+
+/**
+ * @brief start time of an instrumented call, 0 while recording is off.
+ */
+static inline uint64_t bc_stats_begin(void) {
+    return __atomic_load_n(&g_stats_enabled, __ATOMIC_RELAXED) ? bc_stats_now() : 0;
+}
+
+/**
+ * @brief records the latency of a call started with bc_stats_begin.
+ *
+ * @param id    id of the operation, -1 until it is registered as name on
+ *              its first recording
+ */
+static inline void bc_stats_end(int *id, const char *name, uint64_t t0) {
+    if (t0 == 0)
+        return;
+    int op = __atomic_load_n(id, __ATOMIC_RELAXED);
+    if (op < 0) {
+        op = bc_stats_register(name);
+        __atomic_store_n(id, op, __ATOMIC_RELAXED);
+    }
+    if (op >= 0)
+        bc_stats_record(op, t0);
+}
+/** @} */
+#endif // STATS_H
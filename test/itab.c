@@ -40,6 +40,250 @@ START_TEST(_demo ){
 }
 END_TEST
 
+START_TEST(_insert_batch ){
+    const char *keys[] = { "TKL", "SMR", "SWE", "SLV", "THA", "TGO", "SVN" };
+    void *values[] = { "Tokelau", "San Marino", "Sweden", "El Salvador",
+                       "Thailand", "Togo", "Slovenia" };
+    t_itab itab = itab_new();
+    itab_insert(itab, "SOM", "Somalia" );
+    itab_insert_batch(itab, 7, keys, values);
+    ck_assert_int_eq(itab_lines(itab), 8);
+    ck_assert_str_eq(itab_read(itab, "SWE"), "Sweden");
+    ck_assert_str_eq(itab_read(itab, "SOM"), "Somalia");
+    ck_assert_ptr_null(itab_read(itab, "DEU"));
+
+    const char *prev = "";
+    for( t_itab_iter i = itab_foreach(itab); i; i = itab_next(i)){
+        ck_assert(strcmp(prev, itab_key(i)) < 0);
+        prev = itab_key(i);
+    }
+    itab = itab_free(itab);
+}
+END_TEST
+
+START_TEST(_budget ){
+    char key[10];
+    t_itab itab = itab_new();
+    bc_mem_budget(itab, 0, 8192, NULL, NULL);
+    int i = 0;
+    for(; i < 1000; i++){
+        sprintf(key, "K%04d", i);
+        if(!itab_insert(itab, key, "value")) break;
+    }
+    ck_assert_int_lt(i, 1000);
+    ck_assert_int_eq(itab_lines(itab), i);
+    ck_assert_uint_le(bc_mem_usage(itab), 8192);
+    ck_assert_str_eq(itab_read(itab, "K0000"), "value");
+    itab = itab_free(itab);
+}
+END_TEST
+
+START_TEST(_delete ){
+    t_itab itab = itab_new();
+    itab_insert(itab, "TKL", "Tokelau" );
+    itab_insert(itab, "SMR", "San Marino" );
+    itab_insert(itab, "SWE", "Sweden" );
+    itab_insert(itab, "SLV", "El Salvador" );
+    itab_insert(itab, "THA", "Thailand" );
+
+    ck_assert(itab_delete(itab, "SMR"));
+    ck_assert(!itab_delete(itab, "SMR"));
+    ck_assert(!itab_delete(itab, "DEU"));
+    ck_assert_ptr_null(itab_read(itab, "SMR"));
+    ck_assert_int_eq(itab_lines(itab), 4);
+    for( t_itab_iter i = itab_foreach(itab); i; i = itab_next(i))
+        ck_assert_str_ne(itab_key(i), "SMR");
+
+    ck_assert(itab_update(itab, "SWE", "Kingdom of Sweden"));
+    ck_assert_str_eq(itab_read(itab, "SWE"), "Kingdom of Sweden");
+    ck_assert(!itab_update(itab, "SMR", "San Marino"));
+    ck_assert(!itab_update(itab, "DEU", "Germany"));
+
+    // upsert revives a deleted row and inserts a missing one
+    ck_assert(itab_upsert(itab, "SMR", "Most Serene Republic"));
+    ck_assert(itab_upsert(itab, "DEU", "Germany"));
+    ck_assert(itab_upsert(itab, "THA", "Kingdom of Thailand"));
+    ck_assert_int_eq(itab_lines(itab), 6);
+    ck_assert_str_eq(itab_read(itab, "SMR"), "Most Serene Republic");
+    ck_assert_str_eq(itab_read(itab, "THA"), "Kingdom of Thailand");
+    ck_assert_str_eq(itab_read(itab, "DEU"), "Germany");
+
+    // a table with only deleted rows iterates nothing
+    const char *keys[] = { "DEU", "SLV", "SMR", "SWE", "THA", "TKL" };
+    for(int i = 0; i < 6; i++)
+        ck_assert(itab_delete(itab, keys[i]));
+    ck_assert_int_eq(itab_lines(itab), 0);
+    ck_assert_ptr_null(itab_foreach(itab));
+    itab = itab_free(itab);
+}
+END_TEST
+
+START_TEST(_compact ){
+    char key[10];
+    t_itab itab = itab_new();
+    bc_mem_budget(itab, 0, 1 << 20, NULL, NULL);
+    for(int i = 0; i < 100; i++){
+        sprintf(key, "K%04d", i);
+        itab_insert(itab, key, "value");
+    }
+    size_t full = bc_mem_usage(itab);
+    for(int i = 0; i < 100; i += 2){
+        sprintf(key, "K%04d", i);
+        ck_assert(itab_delete(itab, key));
+    }
+    // the keys of the deleted rows are released by the compaction
+    ck_assert_uint_lt(bc_mem_usage(itab), full);
+    ck_assert_int_eq(itab_lines(itab), 50);
+    for(int i = 0; i < 100; i++){
+        sprintf(key, "K%04d", i);
+        if(i % 2)
+            ck_assert_str_eq(itab_read(itab, key), "value");
+        else
+            ck_assert_ptr_null(itab_read(itab, key));
+    }
+    int n = 0;
+    for( t_itab_iter i = itab_foreach(itab); i; i = itab_next(i))
+        n++;
+    ck_assert_int_eq(n, 50);
+    itab = itab_free(itab);
+}
+END_TEST
+
+static t_itab iso_table(const char **keys, const char **values, int n){
+    t_itab itab = itab_new();
+    for(int i = 0; i < n; i++)
+        itab_insert(itab, keys[i], (void*)values[i]);
+    return itab;
+}
+
+static int g_pairs;
+
+static void count_pair(const char *key, void *left, void *right, void *user){
+    (void)user;
+    ck_assert_str_eq(left, key);
+    ck_assert_ptr_nonnull(right);
+    __atomic_fetch_add(&g_pairs, 1, __ATOMIC_RELAXED);
+}
+
+START_TEST(_set_ops ){
+    const char *ka[] = { "SMR", "SWE", "SLV", "THA", "TGO" };
+    const char *kb[] = { "SWE", "TGO", "TKL", "DEU" };
+    const char *vb[] = { "Stockholm", "Lome", "Nukunonu", "Berlin" };
+    t_itab a = iso_table(ka, ka, 5);
+    t_itab b = iso_table(kb, vb, 4);
+    itab_delete(a, "SLV");
+
+    g_pairs = 0;
+    itab_join(a, b, count_pair, NULL);
+    ck_assert_int_eq(g_pairs, 2);
+
+    t_itab r = itab_intersect(a, b);
+    ck_assert_int_eq(itab_lines(r), 2);
+    ck_assert_str_eq(itab_read(r, "SWE"), "SWE");
+    ck_assert_str_eq(itab_read(r, "TGO"), "TGO");
+    r = itab_free(r);
+
+    r = itab_difference(a, b);
+    ck_assert_int_eq(itab_lines(r), 2);
+    ck_assert_str_eq(itab_read(r, "SMR"), "SMR");
+    ck_assert_str_eq(itab_read(r, "THA"), "THA");
+    ck_assert_ptr_null(itab_read(r, "SLV"));
+    r = itab_free(r);
+
+    r = itab_union(a, b);
+    ck_assert_int_eq(itab_lines(r), 6);
+    ck_assert_str_eq(itab_read(r, "SWE"), "SWE");
+    ck_assert_str_eq(itab_read(r, "DEU"), "Berlin");
+    ck_assert_str_eq(itab_read(r, "TKL"), "Nukunonu");
+    const char *prev = "";
+    for( t_itab_iter i = itab_foreach(r); i; i = itab_next(i)){
+        ck_assert(strcmp(prev, itab_key(i)) < 0);
+        prev = itab_key(i);
+    }
+    r = itab_free(r);
+    a = itab_free(a);
+    b = itab_free(b);
+}
+END_TEST
+
+START_TEST(_join_parallel ){
+    enum { ROWS = 20000 };
+    static char keys[ROWS][8];
+    static const char *key_ptrs[ROWS];
+    static void *matches[ROWS];
+    for(int i = 0; i < ROWS; i++){
+        sprintf(keys[i], "K%05d", i);
+        key_ptrs[i] = keys[i];
+        matches[i] = "match";
+    }
+    t_itab a = itab_new();
+    itab_insert_batch(a, ROWS, key_ptrs, (void**)key_ptrs);
+    // every third key, with a duplicate of K00000
+    t_itab b = itab_new();
+    for(int i = 0; i < ROWS / 3 + 1; i++)
+        key_ptrs[i] = keys[i * 3];
+    key_ptrs[ROWS / 3 + 1] = keys[0];
+    itab_insert_batch(b, ROWS / 3 + 2, key_ptrs, matches);
+
+    g_pairs = 0;
+    itab_join_parallel(a, b, 4, count_pair, NULL);
+    ck_assert_int_eq(g_pairs, 6668);
+    g_pairs = 0;
+    itab_join(a, b, count_pair, NULL);
+    ck_assert_int_eq(g_pairs, 6668);
+    a = itab_free(a);
+    b = itab_free(b);
+}
+END_TEST
+
+START_TEST(_fixed ){
+    const char *keys[] = { "TKL", "SMR", "SWE", "SLV", "THA", "TGO", "SVN",
+                           "S", "SW", "SWEDEN", "ABCDEFGHIJKLMNO" };
+    t_itab fixed = itab_new_fixed();
+    t_itab generic = itab_new();
+    for(int i = 0; i < 11; i++){
+        ck_assert(itab_insert(fixed, keys[i], (void*)keys[i]));
+        ck_assert(itab_insert(generic, keys[i], (void*)keys[i]));
+    }
+    ck_assert(!itab_insert(fixed, "ABCDEFGHIJKLMNOP", "too long"));
+    ck_assert_ptr_null(itab_read(fixed, "ABCDEFGHIJKLMNOP"));
+    ck_assert_int_eq(itab_lines(fixed), 11);
+    for(int i = 0; i < 11; i++)
+        ck_assert_str_eq(itab_read(fixed, keys[i]), keys[i]);
+    ck_assert_ptr_null(itab_read(fixed, "SWED"));
+
+    // both variants sort the keys the same way
+    t_itab_iter j = itab_foreach(generic);
+    for( t_itab_iter i = itab_foreach(fixed); i; i = itab_next(i)){
+        ck_assert_str_eq(itab_key(i), itab_key(j));
+        j = itab_next(j);
+    }
+    ck_assert_ptr_null(j);
+
+    g_pairs = 0;
+    itab_join(generic, fixed, count_pair, NULL);
+    ck_assert_int_eq(g_pairs, 11);
+
+    ck_assert(itab_delete(fixed, "SW"));
+    ck_assert(itab_upsert(fixed, "SW", "SW"));
+    ck_assert(itab_update(fixed, "SWE", "Sweden"));
+    ck_assert_str_eq(itab_read(fixed, "SWE"), "Sweden");
+
+    t_itab r = itab_difference(fixed, generic);
+    ck_assert_int_eq(itab_lines(r), 0);
+    r = itab_free(r);
+    fixed = itab_free(fixed);
+
+    fixed = itab_new_fixed();
+    ck_assert(itab_insert_batch(fixed, 7, keys, (void**)keys));
+    ck_assert(!itab_insert_batch(fixed, 1, (const char*[]){ "ABCDEFGHIJKLMNOP" }, (void**)keys));
+    ck_assert_int_eq(itab_lines(fixed), 7);
+    ck_assert_str_eq(itab_read(fixed, "SLV"), "SLV");
+    fixed = itab_free(fixed);
+    generic = itab_free(generic);
+}
+END_TEST
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // SETUP
@@ -63,5 +307,12 @@ TCase *test_itab(  ) {
     TCase *tcase = tcase_create( "itab" );
     tcase_add_checked_fixture( tcase, setup, teardown );
     tcase_add_test(tcase, _demo);
+    tcase_add_test(tcase, _insert_batch);
+    tcase_add_test(tcase, _budget);
+    tcase_add_test(tcase, _delete);
+    tcase_add_test(tcase, _compact);
+    tcase_add_test(tcase, _set_ops);
+    tcase_add_test(tcase, _join_parallel);
+    tcase_add_test(tcase, _fixed);
     return tcase;
 }
@@ -9,10 +9,12 @@
 Suite *test_suite( void ) {
     extern TCase *test_mem(void);
     extern TCase *test_itab(void);
+    extern TCase *test_stats(void);
     Suite *s;
     s = suite_create( "Memory" );
     suite_add_tcase( s, test_mem(  ) );
     suite_add_tcase( s, test_itab(  ) );
+    suite_add_tcase( s, test_stats(  ) );
     return s;
 }
 
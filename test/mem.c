@@ -2,6 +2,7 @@
 #include <check.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <unistd.h>
 #include "mem.h"
 
 struct mem g_mem;
@@ -81,7 +82,7 @@ START_TEST(_realloc){
 
     demo_structure *s2 = bc_mem_realloc(NULL, s1, demo_structure, 3);
 
-    ck_assert_ptr_ne(s, s2);
+    ck_assert_ptr_ne(s1, s2);
     ck_assert_ptr_nonnull(s2);
     ck_assert(bc_mem_is_valid(s2));
     ck_assert_str_eq(s2[0].name, orig);
@@ -91,6 +92,279 @@ START_TEST(_realloc){
 }
 END_TEST
 
+START_TEST(_zero){
+    demo_structure *s = bc_mem_alloc(NULL, demo_structure);
+    memset(s, '.', sizeof(*s));
+    ck_assert(bc_mem_is_valid(s));
+    bc_mem_checkpoint(s);
+    s = bc_mem_unlink(s);
+
+    // the recycled chunk is cleared only on request
+    demo_structure *z = bc_mem_zero(NULL, demo_structure);
+    ck_assert(bc_mem_is_valid(z));
+    ck_assert_int_eq(z->id, 0);
+    ck_assert_int_eq(z->name[0], 0);
+    ck_assert_int_eq(z->name[99], 0);
+    z->id = 1;
+    ck_assert(!bc_mem_is_valid(z));
+
+    int *a = bc_mem_zero_array(NULL, int, 20);
+    for(int i = 0; i < 20; i++) ck_assert_int_eq(a[i], 0);
+    a[0] = 7;
+    a = bc_mem_realloc(NULL, a, int, 40);
+    ck_assert(bc_mem_is_valid(a));
+    ck_assert_int_eq(a[0], 7);
+    for(int i = 1; i < 40; i++) ck_assert_int_eq(a[i], 0);
+}
+END_TEST
+
+START_TEST(_batch){
+    demo_structure *ctx = bc_mem_alloc(NULL, demo_structure);
+    demo_structure *s[50];
+    int n = bc_mem_alloc_batch(ctx, demo_structure, 50, s);
+    ck_assert_int_eq(n, 50);
+    for(int i = 0; i < n; i++){
+        ck_assert_ptr_nonnull(s[i]);
+        ck_assert(bc_mem_is_valid(s[i]));
+        s[i]->id = i;
+        bc_mem_checkpoint(s[i]);
+    }
+    ck_assert_ptr_ne(s[0], s[1]);
+    ck_assert_int_eq(s[49]->id, 49);
+
+    bc_mem_unlink_batch(s, 25);
+    ck_assert_ptr_null(s[0]);
+    ck_assert_ptr_null(s[24]);
+    ck_assert(bc_mem_is_valid(s[25]));
+
+    // the remaining chunks go away with their context and are recycled
+    demo_structure *rest = s[25];
+    bc_mem_unlink(ctx);
+    n = bc_mem_alloc_batch(NULL, demo_structure, 50, s);
+    ck_assert_int_eq(n, 50);
+    bool reused = false;
+    for(int i = 0; i < n; i++) reused |= (s[i] == rest);
+    ck_assert(reused);
+    bc_mem_unlink_batch(s, n);
+}
+END_TEST
+
+static int g_soft_calls = 0;
+
+static void soft_limit(void *ctx, size_t used, size_t limit, void *user){
+    ck_assert_ptr_eq(ctx, user);
+    ck_assert_uint_gt(used, limit);
+    g_soft_calls++;
+}
+
+START_TEST(_budget){
+    demo_structure *ctx = bc_mem_zero(NULL, demo_structure);
+    demo_structure *before = bc_mem_zero(ctx, demo_structure);
+    ck_assert_uint_eq(bc_mem_usage(ctx), 0);
+
+    g_soft_calls = 0;
+    bc_mem_budget(ctx, 2000, 4000, soft_limit, ctx);
+    size_t base = bc_mem_usage(ctx);
+    ck_assert_uint_gt(base, 0);
+    ck_assert_uint_eq(bc_mem_usage(before), base);
+
+    // descendants are charged to the enclosing budget
+    demo_structure *sub = bc_mem_zero(ctx, demo_structure);
+    demo_structure *leaf = bc_mem_zero(sub, demo_structure);
+    ck_assert_ptr_nonnull(leaf);
+    ck_assert_uint_gt(bc_mem_usage(ctx), base);
+
+    void *p[32];
+    int n = 0;
+    while(n < 32 && (p[n] = bc_mem_zero(leaf, demo_structure)) != NULL) n++;
+    ck_assert_int_lt(n, 32);
+    ck_assert_int_eq(g_soft_calls, 1);
+    ck_assert_uint_le(bc_mem_usage(ctx), 4000);
+
+    // a failed allocation does not touch the old chunk
+    ck_assert_ptr_null(bc_mem_realloc(ctx, leaf, demo_structure, 40));
+    ck_assert(bc_mem_is_valid(leaf));
+
+    // releasing memory makes room again
+    size_t used = bc_mem_usage(ctx);
+    bc_mem_unlink(sub);
+    ck_assert_uint_lt(bc_mem_usage(ctx), used);
+    ck_assert_ptr_nonnull(bc_mem_zero(ctx, demo_structure));
+    ck_assert_int_lt(bc_mem_alloc_batch(ctx, demo_structure, 32, p), 32);
+
+    // lowering the soft limit below the usage raises the callback at once
+    g_soft_calls = 0;
+    bc_mem_budget(ctx, 2 * bc_mem_usage(ctx), 0, soft_limit, ctx);
+    ck_assert_int_eq(g_soft_calls, 0);
+    bc_mem_budget(ctx, 1, 0, soft_limit, ctx);
+    ck_assert_int_eq(g_soft_calls, 1);
+    bc_mem_budget(ctx, 1, 0, soft_limit, ctx);
+    ck_assert_int_eq(g_soft_calls, 1);
+
+    // a short string takes the smallest page
+    base = bc_mem_usage(ctx);
+    ck_assert_ptr_nonnull(bc_mem_strdup(ctx, "SWE"));
+    ck_assert_uint_eq(bc_mem_usage(ctx) - base, 128);
+
+    // a nested budget is charged to the enclosing one until it is released
+    base = bc_mem_usage(ctx);
+    demo_structure *inner = bc_mem_zero(ctx, demo_structure);
+    bc_mem_budget(inner, 0, 0, NULL, NULL);
+    bc_mem_zero(inner, demo_structure);
+    ck_assert_uint_eq(bc_mem_usage(ctx) - base, bc_mem_usage(inner));
+    bc_mem_unlink(inner);
+    ck_assert_uint_eq(bc_mem_usage(ctx), base);
+    bc_mem_unlink(ctx);
+}
+END_TEST
+
+START_TEST(_guarded){
+    long os_page = sysconf(_SC_PAGESIZE);
+    int *buf = bc_mem_guarded_array(NULL, int, 10000);
+    ck_assert_ptr_nonnull(buf);
+    ck_assert_int_eq((long)buf % os_page, 0);
+    ck_assert_int_eq(buf[9999], 0);
+    for(int i = 0; i < 10000; i++) buf[i] = i;
+    bc_mem_checkpoint(buf);
+    ck_assert(bc_mem_is_valid(buf));
+
+    // reading does not count as a change
+    ck_assert_int_eq(buf[5000], 5000);
+    ck_assert(bc_mem_is_valid(buf));
+
+    buf[5000] = -1;
+    ck_assert_int_eq(buf[5000], -1);
+    ck_assert(!bc_mem_is_valid(buf));
+    bc_mem_checkpoint(buf);
+    ck_assert(bc_mem_is_valid(buf));
+
+    // the chunk is writable again once released and recycled
+    bc_mem_unlink(buf);
+    int *again = bc_mem_guarded_array(NULL, int, 10000);
+    ck_assert_ptr_eq(again, buf);
+    ck_assert_int_eq(again[5000], 0);
+    again[1] = 1;
+    ck_assert(bc_mem_is_valid(again));
+}
+END_TEST
+
+START_TEST(_typed){
+    int id = bc_mem_register_type(demo_structure);
+    ck_assert_int_gt(id, 0);
+    ck_assert_int_eq(bc_mem_register_type(demo_structure), id);
+    int other = bc_mem_register_type(double);
+    ck_assert_int_ne(other, id);
+
+    struct bc_mem_type_stats before;
+    ck_assert(bc_mem_type_stats(id, &before));
+    ck_assert_str_eq(before.name, "demo_structure");
+    ck_assert_uint_eq(before.size, sizeof(demo_structure));
+
+    demo_structure *a = bc_mem_alloc_typed(NULL, id);
+    demo_structure *b = bc_mem_alloc_typed(NULL, id);
+    ck_assert_ptr_nonnull(a);
+    ck_assert(bc_mem_is_valid(a));
+    ck_assert_ptr_eq(bc_mem_get_type(a, id), a);
+    ck_assert_ptr_null(bc_mem_get_type(a, other));
+    ck_assert_ptr_null(bc_mem_get_type(bc_mem_alloc(NULL, demo_structure), id));
+
+    // objects of one type are carved out of the same slab
+    long dist = (char*)b - (char*)a;
+    ck_assert(dist > -4096 && dist < 4096);
+
+    // slabs are carved with the exact size of a chunk, not a page size
+    double *d1 = bc_mem_alloc_typed(NULL, other);
+    double *d2 = bc_mem_alloc_typed(NULL, other);
+    ck_assert_int_gt((char*)d2 - (char*)d1, sizeof(double));
+    ck_assert_int_lt((char*)d2 - (char*)d1, 128);
+
+    struct bc_mem_type_stats stats;
+    bc_mem_type_stats(id, &stats);
+    ck_assert_uint_eq(stats.live, before.live + 2);
+
+    bc_mem_unlink(a);
+    ck_assert_ptr_null(bc_mem_get_type(a, id));
+    bc_mem_type_stats(id, &stats);
+    ck_assert_uint_eq(stats.live, before.live + 1);
+    ck_assert_uint_ge(stats.pooled, 1);
+
+    // the pool hands out released objects first
+    ck_assert_ptr_eq(bc_mem_alloc_typed(NULL, id), a);
+    ck_assert(!bc_mem_type_stats(9999, &stats));
+}
+END_TEST
+
+static int g_violations = 0;
+static int g_violation_kind = -1;
+
+static void on_violation(void *ptr, int kind, const char *file, int line, void *user){
+    (void)file;
+    (void)line;
+    if(ptr == user){
+        g_violation_kind = kind;
+        g_violations++;
+    }
+}
+
+START_TEST(_scrub){
+    demo_structure *s = bc_mem_zero(NULL, demo_structure);
+    g_violations = 0;
+    g_violation_kind = -1;
+    ck_assert(bc_mem_scrub_start(0, on_violation, s));
+    ck_assert(!bc_mem_scrub_start(0, on_violation, s));
+
+    // every call is a full pass, the list is walked from its start
+    bc_mem_scrub_step(1000000);
+    ck_assert_int_eq(g_violations, 0);
+
+    s->id = 5;
+    ck_assert_int_ge(bc_mem_scrub_step(1000000), 1);
+    ck_assert_int_eq(g_violations, 1);
+    ck_assert_int_eq(g_violation_kind, BC_MEM_MODIFIED);
+
+    // reported once until the next checkpoint
+    bc_mem_scrub_step(1000000);
+    ck_assert_int_eq(g_violations, 1);
+    bc_mem_checkpoint(s);
+    bc_mem_scrub_step(1000000);
+    ck_assert_int_eq(g_violations, 1);
+
+    // nothing is checked while stopped
+    s->id = 6;
+    bc_mem_scrub_stop();
+    ck_assert_int_eq(bc_mem_scrub_step(1000000), 0);
+    ck_assert_int_eq(g_violations, 1);
+
+    // the background thread starts and stops
+    ck_assert(bc_mem_scrub_start(1000, on_violation, NULL));
+    bc_mem_scrub_stop();
+    // a low rate waits longer between chunks, stopping still wakes it
+    ck_assert(bc_mem_scrub_start(1, on_violation, NULL));
+    bc_mem_scrub_stop();
+    bc_mem_checkpoint(s);
+    ck_assert(bc_mem_is_valid(s));
+}
+END_TEST
+
+START_TEST(_scrub_large){
+    // a byte sum beyond 2^32 wraps like the checksum of the checkpoint
+    int len = 20 << 20;
+    char *big = bc_mem_array(NULL, char, len);
+    memset(big, 0xff, len);
+    bc_mem_checkpoint(big);
+    ck_assert(bc_mem_is_valid(big));
+    g_violations = 0;
+    ck_assert(bc_mem_scrub_start(0, on_violation, big));
+    bc_mem_scrub_step(1000000);
+    ck_assert_int_eq(g_violations, 0);
+    big[len - 1] = 0;
+    bc_mem_scrub_step(1000000);
+    ck_assert_int_eq(g_violations, 1);
+    bc_mem_scrub_stop();
+    bc_mem_unlink(big);
+}
+END_TEST
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // SETUP
@@ -118,5 +392,12 @@ TCase *test_mem(  ) {
     tcase_add_test( tcase, _overwrite );
     tcase_add_test( tcase, _change );
     tcase_add_test( tcase, _realloc );
+    tcase_add_test( tcase, _zero );
+    tcase_add_test( tcase, _batch );
+    tcase_add_test( tcase, _budget );
+    tcase_add_test( tcase, _guarded );
+    tcase_add_test( tcase, _typed );
+    tcase_add_test( tcase, _scrub );
+    tcase_add_test( tcase, _scrub_large );
     return tcase;
 }
@@ -0,0 +1,192 @@
+#include <check.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "itab.h"
+#include "mem.h"
+#include "stats.h"
+
+static const char *g_ops[] = {
+    "itab_insert", "itab_read", "itab_foreach", "itab_next",
+    "mem_realloc", "mem_unlink", "mem_checkpoint",
+};
+#define OPS ( sizeof( g_ops ) / sizeof( g_ops[0] ) )
+
+START_TEST(_disabled ){
+    bc_stats_reset();
+    bc_stats_enable(false);
+    for(unsigned i = 0; i < OPS; i++)
+        ck_assert_int_ge(bc_stats_register(g_ops[i]), 0);
+    t_itab itab = itab_new();
+    itab_insert(itab, "SWE", "Sweden");
+    ck_assert_ptr_nonnull(itab_read(itab, "SWE"));
+    for( t_itab_iter i = itab_foreach(itab); i; i = itab_next(i))
+        ;
+    itab = itab_free(itab);
+
+    struct bc_stats_summary s;
+    for(unsigned i = 0; i < OPS; i++){
+        ck_assert(bc_stats_query(g_ops[i], &s));
+        ck_assert_str_eq(s.name, g_ops[i]);
+        ck_assert_uint_eq(s.count, 0);
+    }
+    ck_assert(!bc_stats_query("no_such_op", &s));
+    ck_assert_uint_eq(bc_stats_percentile("no_such_op", 50.0), 0);
+}
+END_TEST
+
+START_TEST(_register ){
+    int id = bc_stats_register("test_op");
+    ck_assert_int_ge(id, 0);
+    ck_assert_int_eq(bc_stats_register("test_op"), id);
+    ck_assert_int_ne(bc_stats_register("test_other_op"), id);
+
+    bc_stats_reset();
+    bc_stats_enable(true);
+    int cached = -1;
+    for(int i = 0; i < 10; i++)
+        bc_stats_end(&cached, "test_op", bc_stats_begin());
+    bc_stats_enable(false);
+    ck_assert_int_eq(cached, id);
+
+    struct bc_stats_summary s;
+    ck_assert(bc_stats_query("test_op", &s));
+    ck_assert_uint_eq(s.count, 10);
+    ck_assert(bc_stats_query("test_other_op", &s));
+    ck_assert_uint_eq(s.count, 0);
+}
+END_TEST
+
+START_TEST(_itab ){
+    char key[10];
+    bc_stats_reset();
+    bc_stats_enable(true);
+    t_itab itab = itab_new();
+    for(int i = 0; i < 100; i++){
+        sprintf(key, "K%04d", i);
+        itab_insert(itab, key, "value");
+    }
+    for(int i = 0; i < 1000; i++){
+        sprintf(key, "K%04d", i % 100);
+        ck_assert_ptr_nonnull(itab_read(itab, key));
+    }
+    for( t_itab_iter i = itab_foreach(itab); i; i = itab_next(i))
+        ;
+    itab = itab_free(itab);
+    bc_stats_enable(false);
+
+    struct bc_stats_summary s;
+    ck_assert(bc_stats_query("itab_insert", &s));
+    ck_assert_uint_eq(s.count, 100);
+    ck_assert(bc_stats_query("itab_foreach", &s));
+    ck_assert_uint_eq(s.count, 1);
+    // one step per row, the last one ends the iteration
+    ck_assert(bc_stats_query("itab_next", &s));
+    ck_assert_uint_eq(s.count, 100);
+#ifdef BC_MEM_COUNTERS
+    // the keys are allocated through the instrumented calling macros
+    ck_assert(bc_stats_query("mem_alloc", &s));
+    ck_assert_uint_ge(s.count, 100);
+    ck_assert(bc_stats_query("mem_checkpoint", &s));
+    ck_assert_uint_ge(s.count, 100);
+    ck_assert(bc_stats_query("mem_realloc", &s));
+    ck_assert_uint_ge(s.count, 1);
+    ck_assert(bc_stats_query("mem_unlink", &s));
+    ck_assert_uint_ge(s.count, 1);
+#endif
+
+    ck_assert(bc_stats_query("itab_read", &s));
+    ck_assert_str_eq(s.name, "itab_read");
+    ck_assert_uint_eq(s.count, 1000);
+    ck_assert_uint_le(s.min, s.p50);
+    ck_assert_uint_le(s.p50, s.p99);
+    ck_assert_uint_le(s.p99, s.p999);
+    ck_assert_uint_le(s.p999, s.max);
+    ck_assert(s.mean >= s.min && s.mean <= s.max);
+    ck_assert_uint_eq(bc_stats_percentile("itab_read", 100.0), s.max);
+
+    bc_stats_reset();
+    ck_assert(bc_stats_query("itab_read", &s));
+    ck_assert_uint_eq(s.count, 0);
+    ck_assert_uint_eq(bc_stats_percentile("itab_read", 50.0), 0);
+}
+END_TEST
+
+struct reader {
+    t_itab itab;
+    char *data;
+};
+
+static void *reads(void *arg){
+    struct reader *r = arg;
+    for(int i = 0; i < 500; i++){
+        itab_read(r->itab, "SWE");
+        bc_mem_checkpoint(r->data);
+    }
+    return NULL;
+}
+
+START_TEST(_threads ){
+    pthread_t threads[4];
+    struct reader readers[4];
+    t_itab itab = itab_new();
+    itab_insert(itab, "SWE", "Sweden");
+    for(int i = 0; i < 4; i++){
+        readers[i].itab = itab;
+        readers[i].data = bc_mem_zero_array(NULL, char, 64);
+    }
+    bc_stats_reset();
+    bc_stats_enable(true);
+    for(int i = 0; i < 4; i++)
+        pthread_create(&threads[i], NULL, reads, &readers[i]);
+    for(int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+    bc_stats_enable(false);
+    itab = itab_free(itab);
+
+    // the histograms of all threads are merged
+    struct bc_stats_summary s;
+    ck_assert(bc_stats_query("itab_read", &s));
+    ck_assert_uint_eq(s.count, 2000);
+#ifdef BC_MEM_COUNTERS
+    ck_assert(bc_stats_query("mem_checkpoint", &s));
+    ck_assert_uint_eq(s.count, 2000);
+#endif
+
+    char buf[8192];
+    FILE *f = fmemopen(buf, sizeof(buf), "w");
+    bc_stats_dump(f);
+    fclose(f);
+    ck_assert_ptr_nonnull(strstr(buf, "\"name\": \"itab_read\", \"count\": 2000,"));
+    ck_assert_ptr_nonnull(strstr(buf, "\"p999\""));
+    bc_stats_reset();
+}
+END_TEST
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// SETUP
+//
+static void setup(void)
+{
+    bc_mem_init();
+}
+
+//
+// TEARDOWN
+//
+
+static void teardown(void)
+{
+    bc_stats_enable(false);
+}
+
+
+TCase *test_stats(  ) {
+    TCase *tcase = tcase_create( "stats" );
+    tcase_add_checked_fixture( tcase, setup, teardown );
+    tcase_add_test(tcase, _disabled);
+    tcase_add_test(tcase, _register);
+    tcase_add_test(tcase, _itab);
+    tcase_add_test(tcase, _threads);
+    return tcase;
+}